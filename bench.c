@@ -0,0 +1,35 @@
+// Helpers shared by the benchmark programs.
+
+#include "types.h"
+#include "user.h"
+
+// Jain's fairness index of x[0..n-1] in thousandths: 1000 when
+// all are equal, 1000/n when one of them got everything.
+// Values are first scaled to 0..1000 so the sums fit in a uint.
+int
+jain(int *x, int n)
+{
+  uint s, q, v;
+  int i, max;
+
+  max = 0;
+  for(i = 0; i < n; i++)
+    if(x[i] > max)
+      max = x[i];
+  if(max == 0)
+    return 0;
+  s = q = 0;
+  for(i = 0; i < n; i++){
+    v = (uint)x[i] * 1000 / max;
+    s += v;
+    q += v * v;
+  }
+  return s * s / (n * q / 1000);
+}
+
+// Print label and then v thousandths as a decimal.
+void
+permille(char *label, int v)
+{
+  printf(1, "%s%d.%d%d%d\n", label, v / 1000, v / 100 % 10, v / 10 % 10, v % 10);
+}
@@ -5,7 +5,10 @@ struct inode;
 struct pipe;
 struct proc;
 struct rtcdate;
+struct runq;
 struct spinlock;
+struct rwlock;
+struct sembuf;
 struct sleeplock;
 struct stat;
 struct superblock;
@@ -40,6 +43,7 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+void            iexec(struct inode*, int);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -68,6 +72,8 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kref(char*);
+int             krefs(char*);
 
 // kbd.c
 void            kbdintr(void);
@@ -75,6 +81,8 @@ void            kbdintr(void);
 // lapic.c
 void            cmostime(struct rtcdate *r);
 int             lapicid(void);
+void            lapicipi(int, int);
+void            lapictimer(int);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
@@ -95,6 +103,11 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pcache.c
+void            pcinit(void);
+char*           pcget(struct inode*, uint);
+void            pcdrop(struct inode*);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -119,27 +132,47 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+void            wakeproc(struct proc*, void*);
+int             parentpid(void);
 void            yield(void);
 int             find_largest_prime_factor(int);
 
 void            age(void);
-float           get_rank(struct proc* p);
-unsigned        rand(void);
-struct proc*    round_robin_sched(void);
+int             get_rank(struct proc* p);
+unsigned        rand(struct runq*);
+struct proc*    round_robin_sched(struct runq*);
 int             change_queue(int, int);
 int             set_bjf_process(int, int, int, int);
 int             set_bjf(int, int, int);
-int             set_ticket(int,int,int);
-void            printp(void);
+int             set_ticket(int, int);
 void            changeq(int, int);
-void            printp(void);
+int             setquantum(int, int);
+int             timeslice(void);
+int             getprocinfo(uint, int, uint, int);
 
-struct proc*    lot_sched(void);
-struct proc*    bjf_sched(void);
+struct proc*    lot_sched(struct runq*);
+struct proc*    bjf_sched(struct runq*);
+struct proc*    dequeue(struct runq*);
+void            requeue(struct proc*, int);
+int             boost(struct proc*, int, int);
+int             boostpid(int, int, int, int);
+void            unboost(struct proc*);
+void            unboostpid(int);
+int             leastloaded(void);
+struct proc*    steal(int);
+void            setrank(struct proc*);
 
-int             sem_init(int,int);
-int             sem_acquire(int);
-int             sem_release(int);
+// sem.c
+void            seminit(void);
+int             sem_create(char*, int);
+int             sem_destroy(int);
+int             sem_wait(int);
+int             sem_post(int);
+int             sem_timedwait(int, int);
+int             semop(struct sembuf*, int);
+int             semdup(struct proc*);
+int             semexec(pde_t*);
+void            semexit(void);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -152,6 +185,14 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
+int             lockstatcopy(uint, int);
+
+// rwlock.c
+void            initrwlock(struct rwlock*, char*);
+void            acquireread(struct rwlock*);
+void            releaseread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+void            releasewrite(struct rwlock*);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -179,6 +220,11 @@ void            syscall(void);
 // timer.c
 void            timerinit(void);
 
+// trace.c
+void            traceinit(void);
+void            trace(int, struct proc*, int);
+int             tracecopy(uint, int);
+
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
@@ -199,8 +245,12 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
+int             mapsempage(pde_t*, int, char*);
+void            unmapsempage(pde_t*, int);
 pde_t*          copyuvm(pde_t*, uint);
+int             cowfault(pde_t*, uint);
+int             lazyfault(struct proc*, uint);
+int             prefault(uint, uint, int);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
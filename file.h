@@ -14,8 +14,10 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int nexec;          // Processes running it as their program
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  int cached;         // may have pages in the page cache?
 
   short type;         // copy of disk inode
   short major;
@@ -0,0 +1,103 @@
+// Fork storm: concurrent loops of fork, touch some fresh heap,
+// exit and wait, so that page allocation (copyuvm, allocuvm,
+// kernel stacks, page tables) is the hot path.  Reports forks
+// per second and, when the kernel keeps lock statistics, how
+// often the page allocator's kmem lock was taken and contended.
+// usage: forkstorm [procs] [ticks] [pages]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockinfo.h"
+
+#define HZ      100
+#define NLOCKS  64
+
+struct lockinfo before[NLOCKS], after[NLOCKS];
+
+void
+fail(char *what)
+{
+  printf(1, "forkstorm: %s failed\n", what);
+  exit();
+}
+
+// The kmem entry of a lockstat snapshot, or 0.
+struct lockinfo*
+kmem(struct lockinfo *li, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(strcmp(li[i].name, "kmem") == 0)
+      return &li[i];
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct lockinfo *b, *a;
+  int nproc, window, pages, i, j, pid, end, fds[2], count, total, m, n;
+  char *p;
+
+  nproc = argc > 1 ? atoi(argv[1]) : 8;
+  window = argc > 2 ? atoi(argv[2]) : 200;
+  pages = argc > 3 ? atoi(argv[3]) : 16;
+  if(nproc <= 0 || window <= 0 || pages < 0){
+    printf(2, "usage: forkstorm [procs] [ticks] [pages]\n");
+    exit();
+  }
+
+  printf(1, "forkstorm: %d loops, %d pages each, %d ticks\n", nproc, pages, window);
+  if(pipe(fds) < 0)
+    fail("pipe");
+  m = lockstat(before, NLOCKS);
+  end = uptime() + window;
+  for(i = 0; i < nproc; i++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork");
+    if(pid == 0){
+      close(fds[0]);
+      count = 0;
+      while(uptime() < end){
+        pid = fork();
+        if(pid < 0)
+          fail("fork");
+        if(pid == 0){
+          if((p = sbrk(pages * 4096)) == (char*)-1)
+            fail("sbrk");
+          for(j = 0; j < pages; j++)
+            p[j * 4096] = j;
+          exit();
+        }
+        wait();
+        count++;
+      }
+      write(fds[1], &count, sizeof(count));
+      exit();
+    }
+  }
+  close(fds[1]);
+  total = 0;
+  for(i = 0; i < nproc; i++){
+    if(read(fds[0], &count, sizeof(count)) != sizeof(count))
+      fail("read");
+    total += count;
+  }
+  close(fds[0]);
+  for(i = 0; i < nproc; i++)
+    wait();
+  n = lockstat(after, NLOCKS);
+
+  printf(1, "  %d forks, %d/s\n", total, total * HZ / window);
+  if(m < 0 || n < 0 || (b = kmem(before, m)) == 0 || (a = kmem(after, n)) == 0)
+    exit();
+  a->nacquire -= b->nacquire;
+  a->ncontend -= b->ncontend;
+  a->spin -= b->spin;
+  printf(1, "  kmem lock: %d acquires (%d per fork), %d contended, %d kcycles spinning\n",
+         a->nacquire, a->nacquire / (total ? total : 1), a->ncontend, a->spin);
+  exit();
+}
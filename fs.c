@@ -266,11 +266,25 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->cached = 1;   // not known; the first pcdrop finds out
   release(&icache.lock);
 
   return ip;
 }
 
+// Count a process starting (n = 1) or ceasing (n = -1) to run
+// ip as its program.  Program pages are read from the file when
+// first touched, so writei refuses to change it meanwhile.  A
+// process starting to run ip holds its lock, so writei, which
+// holds it too, cannot miss the first one.
+void
+iexec(struct inode *ip, int n)
+{
+  acquire(&icache.lock);
+  ip->nexec += n;
+  release(&icache.lock);
+}
+
 // Increment reference count for ip.
 // Returns ip to enable ip = idup(ip1) idiom.
 struct inode*
@@ -430,6 +444,7 @@ itrunc(struct inode *ip)
     ip->addrs[NDIRECT] = 0;
   }
 
+  pcdrop(ip);
   ip->size = 0;
   iupdate(ip);
 }
@@ -494,6 +509,9 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->nexec > 0)
+    return -1;   // a running program (see iexec)
+  pcdrop(ip);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
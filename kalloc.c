@@ -1,6 +1,20 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Each CPU keeps a small cache of free pages, so most kalloc
+// and kfree calls take only that cache's lock, which no other
+// CPU touches unless memory runs out.  An empty cache is
+// refilled with KBATCH pages from the global free list in one
+// go, and a full one gives KBATCH back the same way, so
+// kmem.lock is taken once per batch rather than once per page.
+// When the global list is empty too, kalloc drains the other
+// CPUs' caches into it before giving up.  kmem.lock is taken
+// before a cache's lock.
+//
+// Each page also has a count of the page tables that map it,
+// so that fork can share pages copy-on-write (see vm.c).  kfree
+// drops one reference and only frees the page with the last.
 
 #include "types.h"
 #include "defs.h"
@@ -8,6 +22,10 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "x86.h"
+
+#define KCACHE  64   // most pages a CPU keeps
+#define KBATCH  32   // pages moved to or from the free list at once
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -17,10 +35,18 @@ struct run {
   struct run *next;
 };
 
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+};
+
 struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  struct kcache cache[NCPU];
+  int ref[PHYSTOP / PGSIZE];  // references to each allocated page
 } kmem;
 
 // Initialization happens in two phases.
@@ -31,7 +57,11 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cache[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -59,21 +89,72 @@ freerange(void *vstart, void *vend)
 void
 kfree(char *v)
 {
-  struct run *r;
+  struct run *r, *last;
+  struct kcache *kc;
+  int i, n;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
+  if(kmem.use_lock && (n = xadd(&kmem.ref[V2P(v) / PGSIZE], -1)) != 1){
+    if(n < 1)
+      panic("kfree: not allocated");
+    return;
+  }
 
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
+  if(!kmem.use_lock){
+    // Still booting on one CPU, which has no cpuid yet.
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    return;
+  }
+
+  pushcli();
+  kc = &kmem.cache[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  if(++kc->n <= KCACHE){
+    release(&kc->lock);
+    popcli();
+    return;
+  }
+  r = last = kc->freelist;
+  for(i = 1; i < KBATCH; i++)
+    last = last->next;
+  kc->freelist = last->next;
+  kc->n -= KBATCH;
+  release(&kc->lock);
+  acquire(&kmem.lock);
+  last->next = kmem.freelist;
   kmem.freelist = r;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  release(&kmem.lock);
+  popcli();
+}
+
+// Move every page in the other CPUs' caches to the global
+// free list.  Caller holds kmem.lock.
+static void
+drain(struct kcache *self)
+{
+  struct kcache *kc;
+  struct run *r;
+
+  for(kc = kmem.cache; kc < &kmem.cache[NCPU]; kc++){
+    if(kc == self || kc->n == 0)
+      continue;
+    acquire(&kc->lock);
+    while((r = kc->freelist) != 0){
+      kc->freelist = r->next;
+      r->next = kmem.freelist;
+      kmem.freelist = r;
+    }
+    kc->n = 0;
+    release(&kc->lock);
+  }
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -83,14 +164,56 @@ char*
 kalloc(void)
 {
   struct run *r;
+  struct kcache *kc;
 
-  if(kmem.use_lock)
+  if(!kmem.use_lock){
+    r = kmem.freelist;
+    if(r){
+      kmem.freelist = r->next;
+      kmem.ref[V2P(r) / PGSIZE] = 1;
+    }
+    return (char*)r;
+  }
+
+  pushcli();
+  kc = &kmem.cache[cpuid()];
+  acquire(&kc->lock);
+  if(kc->n == 0){
+    release(&kc->lock);
     acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
+    if(kmem.freelist == 0)
+      drain(kc);
+    acquire(&kc->lock);
+    while(kc->n < KBATCH && (r = kmem.freelist) != 0){
+      kmem.freelist = r->next;
+      r->next = kc->freelist;
+      kc->freelist = r;
+      kc->n++;
+    }
     release(&kmem.lock);
+  }
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->n--;
+    kmem.ref[V2P(r) / PGSIZE] = 1;
+  }
+  release(&kc->lock);
+  popcli();
   return (char*)r;
 }
 
+// Take another reference to page v, for one more mapping.
+void
+kref(char *v)
+{
+  xadd(&kmem.ref[V2P(v) / PGSIZE], 1);
+}
+
+// Number of references to page v.
+int
+krefs(char *v)
+{
+  return kmem.ref[V2P(v) / PGSIZE];
+}
+
@@ -113,6 +113,32 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Send interrupt vector to the CPU with the given APIC ID.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
+// Stop (on == 0) or restart this CPU's periodic timer.
+// Idle CPUs other than the one that counts ticks stop it
+// so that they stay halted until an interrupt or IPI.
+void
+lapictimer(int on)
+{
+  if(!lapic)
+    return;
+  if(on)
+    lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+  else
+    lapicw(TIMER, MASKED | PERIODIC | (T_IRQ0 + IRQ_TIMER));
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -0,0 +1,11 @@
+// Contention statistics for all spinlocks sharing a name,
+// as copied out by lockstat().
+#define LOCKNAME 16   // name length kept, including the nul
+
+struct lockinfo {
+  char name[LOCKNAME];
+  uint nacquire;   // times acquired
+  uint ncontend;   // acquires that had to wait
+  uint spin;       // cycles spent waiting, in units of 1024
+  uint maxhold;    // longest hold, in cycles
+};
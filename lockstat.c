@@ -0,0 +1,71 @@
+// List kernel spinlocks by contention, hottest first.
+// With a tick count, report only what happened while
+// sleeping that long; otherwise totals since boot.
+// usage: lockstat [ticks]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockinfo.h"
+
+#define NLOCKS 64
+
+struct lockinfo before[NLOCKS], after[NLOCKS];
+
+// Hotter: more contended acquires, then more cycles spun.
+int
+hotter(struct lockinfo *a, struct lockinfo *b)
+{
+  if(a->ncontend != b->ncontend)
+    return a->ncontend > b->ncontend;
+  return a->spin > b->spin;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct lockinfo t;
+  int i, j, n, m, ticks;
+
+  ticks = argc > 1 ? atoi(argv[1]) : 0;
+  m = 0;
+  if(ticks > 0){
+    if((m = lockstat(before, NLOCKS)) < 0){
+      printf(2, "lockstat: not built with LOCKSTAT\n");
+      exit();
+    }
+    sleep(ticks);
+  }
+  if((n = lockstat(after, NLOCKS)) < 0){
+    printf(2, "lockstat: not built with LOCKSTAT\n");
+    exit();
+  }
+
+  // Names are only ever appended, so entry i is the same lock
+  // name in both snapshots.
+  for(i = 0; i < m && i < n; i++){
+    after[i].nacquire -= before[i].nacquire;
+    after[i].ncontend -= before[i].ncontend;
+    after[i].spin -= before[i].spin;
+  }
+
+  for(i = 1; i < n; i++){
+    t = after[i];
+    for(j = i; j > 0 && hotter(&t, &after[j-1]); j--)
+      after[j] = after[j-1];
+    after[j] = t;
+  }
+
+  if(ticks > 0)
+    printf(1, "over %d ticks:\n", ticks);
+  printf(1, "name   acquires   contended   contended%%   spin-kcycles   max-hold\n");
+  for(i = 0; i < n; i++){
+    if(after[i].nacquire == 0)
+      continue;
+    printf(1, "%s   %d   %d   %d   %d   %d\n", after[i].name,
+           after[i].nacquire, after[i].ncontend,
+           after[i].ncontend * 100 / after[i].nacquire,
+           after[i].spin, after[i].maxhold);
+  }
+  exit();
+}
@@ -28,8 +28,11 @@ main(void)
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
+  traceinit();     // scheduler trace rings
   binit();         // buffer cache
+  pcinit();        // program page cache
   fileinit();      // file table
+  seminit();       // semaphore table
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
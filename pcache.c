@@ -0,0 +1,177 @@
+// Page cache for program files.
+//
+// exec maps a program's segments without reading them, and a
+// page fault on one fills the page from the file (see lazyfault
+// in vm.c).  Pages with no bss to zero come from this cache:
+// each entry holds the PGSIZE bytes of a file starting at some
+// offset, keyed by (dev, inum, off), and the page is mapped
+// straight into every process running the program, read-only
+// for text and copy-on-write for data, so repeated execs
+// neither read the disk nor copy pages they never write.
+//
+// The cache owns one reference on each page it holds (see
+// kref in kalloc.c), so a page it evicts stays in use by the
+// processes mapping it.  A program file cannot be written while
+// a process runs it (see iexec in fs.c), since its pages are
+// read as they are first touched; writing it at other times
+// drops its entries.
+//
+// Entries are found through a hash on the key and replaced in
+// clock order, passing over pages that processes still map: as
+// long as one process runs a program, the next exec of it finds
+// the same pages, so any number of processes running it share
+// one copy of its text.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPCHASH  64
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;
+  char *page;           // 0 if the entry is free
+  struct pcpage *next;  // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage page[NPCACHE];
+  struct pcpage *hash[NPCHASH];
+  int hand;             // next entry to replace
+} pcache;
+
+static struct pcpage**
+bucket(uint dev, uint inum, uint off)
+{
+  return &pcache.hash[(dev * 31 + inum * 17 + off / PGSIZE) % NPCHASH];
+}
+
+// Pick an entry to replace: the first free one or one whose
+// page only the cache holds, from the clock hand on, or the
+// one at the hand if every page is mapped.  Caller holds
+// pcache.lock.
+static struct pcpage*
+victim(void)
+{
+  struct pcpage *e;
+  int i;
+
+  for(i = 0; i < NPCACHE; i++){
+    e = &pcache.page[(pcache.hand + i) % NPCACHE];
+    if(e->page == 0 || krefs(e->page) == 1)
+      break;
+  }
+  if(i == NPCACHE)
+    i = 0;
+  e = &pcache.page[(pcache.hand + i) % NPCACHE];
+  pcache.hand = (pcache.hand + i + 1) % NPCACHE;
+  return e;
+}
+
+// Take e out of its hash chain and drop the cache's reference
+// on its page.  Caller holds pcache.lock.
+static void
+evict(struct pcpage *e)
+{
+  struct pcpage **pp;
+
+  for(pp = bucket(e->dev, e->inum, e->off); *pp; pp = &(*pp)->next){
+    if(*pp == e){
+      *pp = e->next;
+      break;
+    }
+  }
+  kfree(e->page);
+  e->page = 0;
+}
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+static struct pcpage*
+lookup(uint dev, uint inum, uint off)
+{
+  struct pcpage *e;
+
+  for(e = *bucket(dev, inum, off); e; e = e->next)
+    if(e->dev == dev && e->inum == inum && e->off == off)
+      return e;
+  return 0;
+}
+
+// Return a page holding the PGSIZE bytes of ip from off, zero
+// past the end of the file, with a reference for the caller,
+// or 0 if out of memory.  ip must not be locked.
+char*
+pcget(struct inode *ip, uint off)
+{
+  struct pcpage *e;
+  char *mem;
+
+  acquire(&pcache.lock);
+  if((e = lookup(ip->dev, ip->inum, off)) != 0){
+    kref(e->page);
+    release(&pcache.lock);
+    return e->page;
+  }
+  release(&pcache.lock);
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  ilock(ip);
+  if(readi(ip, mem, off, PGSIZE) < 0){
+    iunlock(ip);
+    kfree(mem);
+    return 0;
+  }
+  // Insert while holding the inode lock, so that a write to the
+  // file, which drops its entries, cannot slip in between.
+  ip->cached = 1;
+  acquire(&pcache.lock);
+  if((e = lookup(ip->dev, ip->inum, off)) == 0){
+    e = victim();
+    if(e->page)
+      evict(e);
+    e->dev = ip->dev;
+    e->inum = ip->inum;
+    e->off = off;
+    e->page = mem;
+    e->next = *bucket(ip->dev, ip->inum, off);
+    *bucket(ip->dev, ip->inum, off) = e;
+  } else {
+    kfree(mem);
+  }
+  kref(e->page);
+  release(&pcache.lock);
+  iunlock(ip);
+  return e->page;
+}
+
+// Forget the cached pages of ip, which is about to change.
+// Caller holds ip's lock.
+void
+pcdrop(struct inode *ip)
+{
+  struct pcpage *e;
+
+  if(!ip->cached)
+    return;
+  ip->cached = 0;
+  acquire(&pcache.lock);
+  for(e = pcache.page; e < &pcache.page[NPCACHE]; e++)
+    if(e->page && e->dev == ip->dev && e->inum == ip->inum)
+      evict(e);
+  release(&pcache.lock);
+}
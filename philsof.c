@@ -1,38 +1,211 @@
+// Dining philosophers benchmark.  n philosophers sit around a
+// table with a chopstick between each pair; each repeatedly
+// waits for both of its sticks, eats for some ticks, puts them
+// down and thinks for some ticks, until the run is over.  It
+// reports meals per second and, per philosopher, meals and a
+// histogram of the time spent waiting for the sticks, and names
+// any philosopher that starved: no meal, or one wait longer
+// than the starvation limit.
+//
+// The sticks are taken either together with one semop, or one
+// at a time, lower-numbered stick first, with sem_acquire.
+// usage: philsof [-n phil] [-e eat] [-t think] [-d ticks]
+//                [-q level] [-s limit] [-o]
+
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "sem.h"
+
+#define HZ      100  // timer ticks per second
+#define MAXPHIL 16
+#define NBUCKET 7    // wait histogram: 0, 1, 2-3, ... 32+ ticks
+
+struct result {
+  int id;
+  int meals;
+  int total;         // ticks spent waiting
+  int max;           // longest wait
+  int hist[NBUCKET];
+};
+
+int nphil = 5;
+int eat = 1;
+int think = 1;
+int window = 500;
+int level = -1;      // queue level for the philosophers, or as is
+int limit = 0;       // starvation limit, 0 for the default
+int ordered;         // take the sticks one at a time
+
+int stick[MAXPHIL];
+
+void
+fail(char *what)
+{
+  printf(1, "philsof: %s failed\n", what);
+  exit();
+}
+
+int
+bucket(int w)
+{
+  int b;
+
+  for(b = 0; w > 0 && b < NBUCKET - 1; b++)
+    w >>= 1;
+  return b;
+}
+
+// Take both of id's sticks.
+void
+pickup(int id)
+{
+  struct sembuf ops[2];
+  int a, b, t;
+
+  a = stick[id];
+  b = stick[(id + 1) % nphil];
+  if(ordered){
+    if(a > b){
+      t = a;
+      a = b;
+      b = t;
+    }
+    if(sem_acquire(a) < 0 || sem_acquire(b) < 0)
+      fail("sem_acquire");
+    return;
+  }
+  ops[0].sem = a;
+  ops[1].sem = b;
+  ops[0].n = ops[1].n = -1;
+  if(semop(ops, 2) < 0)
+    fail("semop");
+}
+
+void
+putdown(int id)
+{
+  sem_release(stick[id]);
+  sem_release(stick[(id + 1) % nphil]);
+}
+
+void
+philosopher(int id, int end, int fd)
+{
+  struct result r;
+  int t0, w;
+
+  if(level >= 0)
+    change_queue(getpid(), level);
+  memset(&r, 0, sizeof(r));
+  r.id = id;
+  while(uptime() < end){
+    t0 = uptime();
+    pickup(id);
+    w = uptime() - t0;
+    r.meals++;
+    r.total += w;
+    if(w > r.max)
+      r.max = w;
+    r.hist[bucket(w)]++;
+    sleep(eat);
+    putdown(id);
+    sleep(think);
+  }
+  write(fd, &r, sizeof(r));
+  exit();
+}
+
+void
+usage(void)
+{
+  printf(2, "usage: philsof [-n phil] [-e eat] [-t think] [-d ticks] [-q level] [-s limit] [-o]\n");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct result r[MAXPHIL], x;
+  int meals[MAXPHIL];
+  int i, j, pid, fds[2], end, total, starved;
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-o") == 0){
+      ordered = 1;
+      continue;
+    }
+    if(argv[i][0] != '-' || argv[i][2] || i + 1 >= argc)
+      usage();
+    j = atoi(argv[++i]);
+    switch(argv[i-1][1]){
+    case 'n': nphil = j; break;
+    case 'e': eat = j; break;
+    case 't': think = j; break;
+    case 'd': window = j; break;
+    case 'q': level = j; break;
+    case 's': limit = j; break;
+    default: usage();
+    }
+  }
+  if(nphil < 2 || nphil > MAXPHIL || eat < 0 || think < 0 || window <= 0)
+    usage();
+  if(limit <= 0)
+    limit = 10 * (eat + think + 1);
+
+  printf(1, "philsof: %d philosophers, eat %d think %d, %d ticks, %s\n",
+         nphil, eat, think, window, ordered ? "ordered" : "semop");
+  for(i = 0; i < nphil; i++)
+    if((stick[i] = sem_create("", 1)) < 0)
+      fail("sem_create");
+  if(pipe(fds) < 0)
+    fail("pipe");
+  end = uptime() + window;
+  for(i = 0; i < nphil; i++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork");
+    if(pid == 0){
+      close(fds[0]);
+      philosopher(i, end, fds[1]);
+    }
+  }
+  close(fds[1]);
+  for(i = 0; i < nphil; i++){
+    if(read(fds[0], &x, sizeof(x)) != sizeof(x))
+      fail("read");
+    r[x.id] = x;
+  }
+  close(fds[0]);
+  for(i = 0; i < nphil; i++)
+    wait();
+  for(i = 0; i < nphil; i++)
+    sem_destroy(stick[i]);
 
-int main(int argc, char *argv[]){   
-
-    int id = atoi(argv[1]);
-
-    while (1)
-    {
-        if (id % 2 == 0){
-            sem_acquire(id);
-            sem_acquire((id+1)%5);
-        } else {
-            sem_acquire((id+1)%5);
-            sem_acquire(id);
-        }
-
-        
-        sleep(2000);
-        sem_acquire(5);
-        printf(1,"Philosopher %d picked up chop stick %d and %d\n",id,id,(id+1)%5);
-        printf(1,"Philosopher %d is eating\n",id);
-        sem_release(5);
-
-        sem_release(id);
-        sem_release(((id+1)%5));
-
-        sleep(1000);
-        sem_acquire(5);
-        printf(1,"Philosopher %d put down chop stick %d and %d\n",id,id,(id+1)%5);
-        printf(1,"Philosopher %d is thinking\n",id);
-        sem_release(5);
-        
+  total = 0;
+  for(i = 0; i < nphil; i++){
+    meals[i] = r[i].meals;
+    total += r[i].meals;
+  }
+  printf(1, "  meals: %d, %d/s\n", total, total * HZ / window);
+  printf(1, "  phil meals  wait avg  max | 0 1 2-3 4-7 8-15 16-31 32+\n");
+  starved = 0;
+  for(i = 0; i < nphil; i++){
+    j = r[i].meals ? r[i].meals : 1;
+    printf(1, "  %d    %d  %d.%d  %d |", i, r[i].meals,
+           r[i].total / j, r[i].total * 10 / j % 10, r[i].max);
+    for(j = 0; j < NBUCKET; j++)
+      printf(1, " %d", r[i].hist[j]);
+    printf(1, "\n");
+  }
+  permille("  fairness: ", jain(meals, nphil));
+  printf(1, "  starved (limit %d ticks):", limit);
+  for(i = 0; i < nphil; i++){
+    if(r[i].meals == 0 || r[i].max > limit){
+      printf(1, " %d", i);
+      starved++;
     }
-    
-    exit();
-}
\ No newline at end of file
+  }
+  printf(1, starved ? "\n" : " none\n");
+  exit();
+}
@@ -6,12 +6,60 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
-
+#include "rwlock.h"
+#include "traps.h"
+#include "trace.h"
+#include "procinfo.h"
+
+#define NPIDHASH 64
+
+// pidlock guards the pid hash, and is held for reading to
+// look a process up or to read its statistics without
+// stopping the scheduler.  It may be taken while holding
+// ptable.lock but never the other way round, and procs leave
+// the hash before their slot is freed, so a proc found with
+// it held stays that proc until it is released.
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct rwlock pidlock;
+  struct proc *pidhash[NPIDHASH];
 } ptable;
 
+// Per-CPU run queues: a FIFO list for round robin, a Fenwick
+// tree of ticket counts indexed by proc slot for the lottery,
+// and a binary min-heap ordered by rank for BJF.  rq->lock
+// protects them, the rq_* fields of the procs linked on them
+// and the rank and tickets of a proc while it is queued.  ptable.lock still guards p->state
+// and the context switch; when both are needed, ptable.lock
+// is acquired first.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NQUEUE];
+  struct proc *tail[NQUEUE];
+  struct proc *bjf[NPROC];     // BJF heap, lowest rank first
+  int nbjf;
+  uint lot[NPROC+1];           // Fenwick tree of queued tickets
+  uint lottotal;               // Sum of the tree
+  uint seed;                   // Lottery PRNG state
+  int nrunnable;
+};
+
+static struct runq runqs[NCPU];
+
+// Time slice of each queue level, in timer ticks.
+static int quantum[NQUEUE] = {
+[ROUND_ROBIN_LVL] 1,
+[LOT_LVL]         2,
+[BJF_LVL]         4,
+};
+
+// BJF ratios of a new proc, as last set for all by set_bjf.
+// Guarded by ptable.lock.
+static struct {
+  int priority, arrival, exec_cycle;
+} bjfratio;
+
 static struct proc *initproc;
 
 int nextpid = 1;
@@ -19,11 +67,88 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void enqueue(struct proc *p);
+static int busiest(int self);
+static void idle(int id);
+static void rq_insert(struct runq *rq, struct proc *p);
+static void rq_remove(struct runq *rq, struct proc *p);
 
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  initrwlock(&ptable.pidlock, "pidhash");
+  for(i = 0; i < NCPU; i++){
+    initlock(&runqs[i].lock, "runq");
+    runqs[i].seed = 0x2545F491 ^ ((i + 1) * 0x9E3779B9);
+  }
+  for(i = 0; i < NPROC; i++)
+    ptable.proc[i].rq_cpu = -1;
+}
+
+static void
+pidhash(struct proc *p)
+{
+  struct proc **pp = &ptable.pidhash[p->pid % NPIDHASH];
+
+  acquirewrite(&ptable.pidlock);
+  p->pidnext = *pp;
+  *pp = p;
+  releasewrite(&ptable.pidlock);
+}
+
+static void
+pidunhash(struct proc *p)
+{
+  struct proc **pp;
+
+  acquirewrite(&ptable.pidlock);
+  for(pp = &ptable.pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  releasewrite(&ptable.pidlock);
+}
+
+// Find the live process with the given pid.
+// The caller holds ptable.pidlock, for reading at least.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = ptable.pidhash[pid % NPIDHASH]; p; p = p->pidnext)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
+// Find the live process with the given pid and return it with
+// ptable.lock held, or return 0 with no lock held.  The lookup
+// takes only the read side of pidlock, so callers that find
+// nothing never touch ptable.lock; pidlock cannot still be held
+// when ptable.lock is taken, so the proc may have been reaped
+// in between and is checked again.  Pids are not reused.
+static struct proc*
+lockproc(int pid)
+{
+  struct proc *p;
+
+  acquireread(&ptable.pidlock);
+  p = findproc(pid);
+  releaseread(&ptable.pidlock);
+  if(p == 0)
+    return 0;
+  acquire(&ptable.lock);
+  if(p->pid != pid || p->state == UNUSED){
+    release(&ptable.lock);
+    return 0;
+  }
+  return p;
 }
 
 // Must be called with interrupts disabled
@@ -89,12 +214,23 @@ found:
   p->state = EMBRYO;
   p->pid = nextpid++;
   p->creation_time = ticks;
-  p->waiting_in_queue_cycle = 0;
   if (p->pid == 1 || p->pid == 2)
     p->queue_lvl = ROUND_ROBIN_LVL;
   else
     p->queue_lvl = LOT_LVL;
+  p->priority = 0;
+  p->arrival = p->creation_time;
   p->exec_cycle = 0;
+  p->priority_ratio = bjfratio.priority;
+  p->arrival_ratio = bjfratio.arrival;
+  p->exec_cycle_ratio = bjfratio.exec_cycle;
+  p->rank = get_rank(p);
+  p->tickets = DEFTICKETS;
+  p->cpu = 0;
+  p->rq_cpu = -1;
+  p->migrations = 0;
+  p->cputicks = 0;
+  p->boosted = 0;
 
   release(&ptable.lock);
 
@@ -119,6 +255,7 @@ found:
   memset(p->context, 0, sizeof *p->context);
   p->context->eip = (uint)forkret;
 
+  pidhash(p);
   return p;
 }
 
@@ -156,11 +293,17 @@ userinit(void)
   acquire(&ptable.lock);
 
   p->state = RUNNABLE;
+  enqueue(p);
 
   release(&ptable.lock);
 }
 
 // Grow current process's memory by n bytes.
+// Growing only moves sz: the new pages are allocated when
+// first touched (see lazyfault in vm.c).  So growing fails only
+// for lack of address space, not memory: a process that
+// touches a new page when there is no memory left is killed,
+// and a system call given such a page as a buffer returns -1.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
@@ -170,8 +313,9 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(n > SEMBASE - sz)
       return -1;
+    sz += n;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -181,14 +325,34 @@ growproc(int n)
   return 0;
 }
 
+int setquantum(int queue, int n)
+{
+  if (queue < 0 || queue >= NQUEUE || n < 1 || n > MAXQUANTUM)
+    return -1;
+  quantum[queue] = n;
+  return 0;
+}
+
+// Charge a timer tick to the running process.  Returns 1
+// when it has used up the time slice of its queue level.
+int timeslice(void)
+{
+  struct proc *p = myproc();
+
+  return ++p->slice >= quantum[p->queue_lvl];
+}
+
 void changeq(int pid, int queue)
 {
   struct proc *p;
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-  {
-    if (p->pid == pid)
-      p->queue_lvl = queue;
-  }
+
+  if (queue < 0 || queue >= NQUEUE)
+    return;
+  if ((p = lockproc(pid)) == 0)
+    return;
+  p->baselvl = queue;  // an explicit level overrides inheritance
+  requeue(p, queue);
+  release(&ptable.lock);
 }
 
 // Create a new process copying p as the parent.
@@ -207,7 +371,11 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0 ||
+     semdup(np) < 0){
+    if(np->pgdir)
+      freevm(np->pgdir);
+    pidunhash(np);
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
@@ -224,6 +392,12 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  if(curproc->exe){
+    np->exe = idup(curproc->exe);
+    iexec(np->exe, 1);
+  }
+  memmove(np->seg, curproc->seg, sizeof(curproc->seg));
+  np->nseg = curproc->nseg;
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -231,7 +405,9 @@ fork(void)
 
   acquire(&ptable.lock);
 
+  np->cpu = leastloaded();
   np->state = RUNNABLE;
+  enqueue(np);
 
   release(&ptable.lock);
 
@@ -259,10 +435,17 @@ exit(void)
     }
   }
 
+  if(curproc->exe)
+    iexec(curproc->exe, -1);
   begin_op();
   iput(curproc->cwd);
+  if(curproc->exe)
+    iput(curproc->exe);
   end_op();
   curproc->cwd = 0;
+  curproc->exe = 0;
+
+  semexit();
 
   acquire(&ptable.lock);
 
@@ -307,6 +490,7 @@ wait(void)
         kfree(p->kstack);
         p->kstack = 0;
         freevm(p->pgdir);
+        pidunhash(p);
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
@@ -327,40 +511,71 @@ wait(void)
     sleep(curproc, &ptable.lock);  //DOC: wait-sleep
   }
 }
-void printp(void)
+// Copy a record for each of up to n live processes to user
+// address dst and return how many were copied. The records are
+// filled in a scratch page with only ptable.pidlock held for
+// reading, so the scheduler keeps running meanwhile and fields
+// it is changing may be a switch out of date; they are copied
+// out after the lock is released.
+int
+getprocinfo(uint dst, int n, uint cdst, int nc)
 {
-  cprintf("name   pid   status   queue   init time   effectiveness   rank   cpu cycles   tickets \n");
+  struct procinfo *pi;
+  struct cpuinfo *ci;
   struct proc *p;
-  int t;
-  acquire(&ptable.lock);
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-  {
-    if (p->pid == 0)
+  int i;
+
+  if(n > NPROC)
+    n = NPROC;
+  if((pi = (struct procinfo*)kalloc()) == 0)
+    return -1;
+  i = 0;
+  acquireread(&ptable.pidlock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC] && i < n; p++){
+    if(p->state == UNUSED)
       continue;
-    t=p->last_tick - p->first_tick ;
-    cprintf("%s  ", p->name);
-    cprintf("%d  ", p->pid);
-    if (p->state == SLEEPING)
-      cprintf("SLEEPING  ");
-    else if (p->state == RUNNABLE)
-      cprintf("RUNNABLE  ");
-    else if (p->state == UNUSED)
-      cprintf("UNUSED  ");
-    else if (p->state == EMBRYO)
-      cprintf("EMBRYO  ");
-    else if (p->state == RUNNING)
-      cprintf("RUNNING  ");
-    else if (p->state == ZOMBIE)
-      cprintf("ZOMBIE  ");
-    cprintf("%d  ", p->queue_lvl);
-    cprintf("%d  ", p->creation_time);
-    cprintf("%d/%d/%d  ", p->arrival_ratio, p->priority_ratio, p->exec_cycle_ratio);
-    cprintf("%d  ", (int)get_rank(p));
-    cprintf("%d  \n", p->exec_cycle);
-    cprintf("%d  \n", t);
+    pi[i].pid = p->pid;
+    pi[i].state = p->state;
+    pi[i].queue_lvl = p->queue_lvl;
+    pi[i].rank = p->rank;
+    pi[i].exec_cycle = p->exec_cycle;
+    pi[i].tickets = p->tickets;
+    pi[i].creation_time = p->creation_time;
+    pi[i].cputicks = p->cputicks;
+    pi[i].cpu = p->cpu;
+    pi[i].migrations = p->migrations;
+    safestrcpy(pi[i].name, p->name, sizeof(pi[i].name));
+    i++;
   }
-  release(&ptable.lock);
+  releaseread(&ptable.pidlock);
+  if(i > 0 && copyout(myproc()->pgdir, dst, pi, i * sizeof(*pi)) < 0)
+    i = -1;
+
+  // The per-CPU counters are read without locks; each is a
+  // word written by its own CPU, so the snapshot is only loose.
+  if(i >= 0 && nc > 0){
+    if(nc > NCPU)
+      nc = NCPU;
+    ci = (struct cpuinfo*)pi;
+    memset(ci, 0, nc * sizeof(*ci));
+    for(n = 0; n < nc; n++){
+      if(n >= ncpu){
+        ci[n].cpu = -1;
+        continue;
+      }
+      ci[n].cpu = n;
+      ci[n].nrunnable = runqs[n].nrunnable;
+      ci[n].nswitch = cpus[n].nswitch;
+      ci[n].nmigrate = cpus[n].nmigrate;
+      ci[n].idleticks = cpus[n].idleticks;
+    }
+    if(copyout(myproc()->pgdir, cdst, ci, nc * sizeof(*ci)) < 0)
+      i = -1;
+  }
+  kfree((char*)pi);
+  return i;
 }
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -374,6 +589,8 @@ scheduler(void)
 {
   struct proc *p = 0;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  struct runq *rq = &runqs[id];
   c->proc = 0;
 
   for (;;)
@@ -381,33 +598,33 @@ scheduler(void)
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-
-    p = round_robin_sched();
-
-    if (p == 0)
-      p = lot_sched();
-
+    // Pick from this CPU's own run queues. Only rq->lock is
+    // taken, so CPUs do not contend with each other here.
+    p = dequeue(rq);
     if (p == 0)
-      p = bjf_sched();
-
+      p = steal(id);
     if (p == 0)
     {
-      release(&ptable.lock);
+      idle(id);
       continue;
     }
-    age();
+
+    // A proc that yielded or slept on another CPU may still be
+    // switching out; ptable.lock is held until it has, so once
+    // we get it the saved context is complete.
+    acquire(&ptable.lock);
     c->proc = p;
     switchuvm(p);
     p->state = RUNNING;
-    p->waiting_in_queue_cycle = 0;
-    struct proc *pc;
-    for (pc = ptable.proc; pc < &ptable.proc[NPROC]; pc++)
+    p->slice = 0;
+    c->nswitch++;
+    trace(TR_PICK, p, p->queue_lvl == BJF_LVL ? p->rank :
+                      p->queue_lvl == LOT_LVL ? p->tickets : 0);
+    if (p->cpu != id)
     {
-      if (pc->pid == p->pid)
-        continue;
-      pc->waiting_in_queue_cycle++;
+      p->migrations++;
+      c->nmigrate++;
+      p->cpu = id;
     }
     swtch(&(c->scheduler), p->context);
     switchkvm();
@@ -450,6 +667,8 @@ yield(void)
   acquire(&ptable.lock);  //DOC: yieldlock
   myproc()->state = RUNNABLE;
   myproc()->exec_cycle += 1;
+  setrank(myproc());
+  enqueue(myproc());
   sched();
   release(&ptable.lock);
 }
@@ -523,8 +742,11 @@ wakeup1(void *chan)
   struct proc *p;
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
+    if(p->state == SLEEPING && p->chan == chan){
       p->state = RUNNABLE;
+      enqueue(p);
+      trace(TR_WAKEUP, p, p->cpu);
+    }
 }
 
 // Wake up all processes sleeping on chan.
@@ -536,6 +758,40 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Wake p alone if it is sleeping on chan, without scanning
+// the process table.  For callers that keep their own queue
+// of waiters.
+void
+wakeproc(struct proc *p, void *chan)
+{
+  acquire(&ptable.lock);
+  if(p->state == SLEEPING && p->chan == chan){
+    p->state = RUNNABLE;
+    enqueue(p);
+    trace(TR_WAKEUP, p, p->cpu);
+  }
+  release(&ptable.lock);
+}
+
+// Pid of the caller's parent, looking through tracers.  Only
+// pidlock is taken: a parent that exits hands its children to
+// init before it can be reaped, and reaping needs pidlock for
+// writing, so the proc read here is still the parent.
+int
+parentpid(void)
+{
+  struct proc *p;
+  int pid;
+
+  acquireread(&ptable.pidlock);
+  p = myproc()->parent;
+  while (p->is_tracer)
+    p = p->tracer_parent;
+  pid = p->pid;
+  releaseread(&ptable.pidlock);
+  return pid;
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -544,19 +800,16 @@ kill(int pid)
 {
   struct proc *p;
 
-  acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+  if((p = lockproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  // Wake process from sleep if necessary.
+  if(p->state == SLEEPING){
+    p->state = RUNNABLE;
+    enqueue(p);
   }
   release(&ptable.lock);
-  return -1;
+  return 0;
 }
 
 //PAGEBREAK: 36
@@ -624,199 +877,586 @@ int find_largest_prime_factor(int n) {
 }
 
 
+// Promote procs that have waited on a lottery or BJF queue
+// for more than AGETICKS since they were queued.  Called from
+// the timer every AGESWEEP ticks, so the cost is independent
+// of how often the scheduler switches.
 void age(void)
 {
-  struct proc *p = 0;
+  struct proc *p;
+  struct runq *rq;
+  int c;
 
   for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
   {
-    if (p->state != RUNNABLE)
+    c = p->rq_cpu;
+    if (c < 0 || p->queue_lvl == ROUND_ROBIN_LVL)
       continue;
-
-    if (p->waiting_in_queue_cycle > 8000)
+    rq = &runqs[c];
+    acquire(&rq->lock);
+    if (p->rq_cpu == c && p->queue_lvl != ROUND_ROBIN_LVL &&
+        ticks - p->enqueued > AGETICKS)
     {
-
-      if (p->queue_lvl == LOT_LVL)
-      {
-        p->queue_lvl = ROUND_ROBIN_LVL;
-      }
-      if (p->queue_lvl == BJF_LVL)
-      {
-        p->queue_lvl = LOT_LVL;
-      }
-      p->waiting_in_queue_cycle = 0;
+      rq_remove(rq, p);
+      p->queue_lvl--;
+      trace(TR_AGE, p, ticks - p->enqueued);
+      rq_insert(rq, p);
     }
+    release(&rq->lock);
   }
 }
 
-float get_rank(struct proc *p)
+// BJF rank in tenths, the ratios being given in tenths.
+int get_rank(struct proc *p)
 {
-  return (float)(p->priority * p->priority_ratio + p->arrival * p->arrival_ratio + p->exec_cycle * p->exec_cycle_ratio) / 10;
+  return p->priority * p->priority_ratio + p->arrival * p->arrival_ratio + p->exec_cycle * p->exec_cycle_ratio;
 }
 
-unsigned short lfsr = 0xACE1u;
-  unsigned bit;
-
-unsigned rand()
+// xorshift32; each run queue draws from its own state.
+// Caller holds rq->lock.
+unsigned
+rand(struct runq *rq)
 {
-  bit  = ((lfsr >> 0) ^ (lfsr >> 2) ^ (lfsr >> 3) ^ (lfsr >> 5) ) & 1;
-  return lfsr =  (lfsr >> 1) | (bit << 15);
+  uint x = rq->seed;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return rq->seed = x;
 }
 
 
-struct proc *
-round_robin_sched(void)
+// Add delta tickets at slot i (1-based) of rq's lottery tree.
+static void
+lot_add(struct runq *rq, int i, int delta)
 {
-  struct proc *chosen_proc = 0;
+  rq->lottotal += delta;
+  for (; i <= NPROC; i += i & -i)
+    rq->lot[i] += delta;
+}
 
-  int now = ticks;
-  int max_process_time = -1e5;
+// Slot (0-based) holding the ticket-th ticket of rq's tree,
+// i.e. the first slot whose prefix sum exceeds ticket.
+static int
+lot_find(struct runq *rq, uint ticket)
+{
+  int pos, step;
 
-  for (struct proc *p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  for (step = 1; step * 2 <= NPROC; step *= 2)
+    ;
+  for (pos = 0; step > 0; step /= 2)
   {
-    if (p->state != RUNNABLE || p->queue_lvl != ROUND_ROBIN_LVL)
-    {
-      continue;
-    }
-
-    if (now - p->last_cpu_time > max_process_time)
+    if (pos + step <= NPROC && rq->lot[pos + step] <= ticket)
     {
-      max_process_time = now - p->last_cpu_time;
-      chosen_proc = p;
-      p->last_cpu_time = now;
+      pos += step;
+      ticket -= rq->lot[pos];
     }
   }
-  return chosen_proc;
+  return pos;
 }
 
-struct proc *
-bjf_sched(void)
+// BJF heap order: lower rank first, ties to the lower pid.
+static int
+rankless(struct proc *a, struct proc *b)
 {
-  struct proc *chosen_proc = 0;
-  int min_rank = -1, rank = -1;
+  if (a->rank != b->rank)
+    return a->rank < b->rank;
+  return a->pid < b->pid;
+}
 
-  for (struct proc *p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+static void
+heap_set(struct runq *rq, int i, struct proc *p)
+{
+  rq->bjf[i] = p;
+  p->bjf_idx = i;
+}
+
+static void
+heap_up(struct runq *rq, int i)
+{
+  struct proc *p = rq->bjf[i];
+  int parent;
+
+  while (i > 0)
   {
-    if (p->state != RUNNABLE || p->queue_lvl != BJF_LVL)
-      continue;
+    parent = (i - 1) / 2;
+    if (!rankless(p, rq->bjf[parent]))
+      break;
+    heap_set(rq, i, rq->bjf[parent]);
+    i = parent;
+  }
+  heap_set(rq, i, p);
+}
 
-    rank = get_rank(p);
-    if (rank < min_rank || min_rank == -1)
-    {
-      chosen_proc = p;
-      min_rank = rank;
-    }
+static void
+heap_down(struct runq *rq, int i)
+{
+  struct proc *p = rq->bjf[i];
+  int child;
+
+  for (;;)
+  {
+    child = 2 * i + 1;
+    if (child >= rq->nbjf)
+      break;
+    if (child + 1 < rq->nbjf && rankless(rq->bjf[child + 1], rq->bjf[child]))
+      child++;
+    if (!rankless(rq->bjf[child], p))
+      break;
+    heap_set(rq, i, rq->bjf[child]);
+    i = child;
   }
+  heap_set(rq, i, p);
+}
 
-  return chosen_proc;
+// Remove the proc at heap slot i.
+static void
+heap_del(struct runq *rq, int i)
+{
+  struct proc *last;
+
+  last = rq->bjf[--rq->nbjf];
+  if (i == rq->nbjf)
+    return;
+  heap_set(rq, i, last);
+  heap_up(rq, i);
+  heap_down(rq, last->bjf_idx);
 }
 
-struct proc *
-lot_sched(void)
+// Link p at the tail of its level on rq, or into the
+// heap for BJF.  Caller holds rq->lock.
+static void
+rq_insert(struct runq *rq, struct proc *p)
 {
-  struct proc *chosen_proc = 0;
-  int ticket=rand()%200;
-  for (struct proc *p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  int lvl = p->queue_lvl;
+
+  p->rq_cpu = rq - runqs;
+  p->enqueued = ticks;
+  rq->nrunnable++;
+  if (lvl == BJF_LVL)
   {
-    if (p->state != RUNNABLE || p->queue_lvl != LOT_LVL)
-      continue;
+    heap_set(rq, rq->nbjf++, p);
+    heap_up(rq, p->bjf_idx);
+    return;
+  }
+  if (lvl == LOT_LVL)
+  {
+    lot_add(rq, p - ptable.proc + 1, p->tickets);
+    return;
+  }
+  p->rq_next = 0;
+  p->rq_prev = rq->tail[lvl];
+  if (rq->tail[lvl])
+    rq->tail[lvl]->rq_next = p;
+  else
+    rq->head[lvl] = p;
+  rq->tail[lvl] = p;
+}
 
-    if (ticket >= p->first_tick  &&  ticket <= p->last_tick)
-    {
-      chosen_proc = p;
-    }
+// Unlink p from rq.  Caller holds rq->lock.
+static void
+rq_remove(struct runq *rq, struct proc *p)
+{
+  int lvl = p->queue_lvl;
+
+  p->rq_cpu = -1;
+  rq->nrunnable--;
+  if (lvl == BJF_LVL)
+  {
+    heap_del(rq, p->bjf_idx);
+    return;
+  }
+  if (lvl == LOT_LVL)
+  {
+    lot_add(rq, p - ptable.proc + 1, -p->tickets);
+    return;
   }
-  return chosen_proc;
+  if (p->rq_prev)
+    p->rq_prev->rq_next = p->rq_next;
+  else
+    rq->head[lvl] = p->rq_next;
+  if (p->rq_next)
+    p->rq_next->rq_prev = p->rq_prev;
+  else
+    rq->tail[lvl] = p->rq_prev;
+  p->rq_next = p->rq_prev = 0;
 }
 
-int set_bjf_process(int pid, int priority_ratio, int arrival_ratio, int exec_cycle_ratio)
+// Wake CPU id if it is halted in idle().
+static void
+kick(int id)
 {
-  for (struct proc *p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  if (cpus[id].idle)
+    lapicipi(cpus[id].apicid, T_IRQ0 + IRQ_RESCHED);
+}
+
+// Put a RUNNABLE proc on the run queue of p->cpu.  If that
+// CPU is halted, wake it; if it is busy and now has a backlog,
+// wake some other halted CPU so it can steal the extra work.
+// Caller holds ptable.lock.
+static void
+enqueue(struct proc *p)
+{
+  struct runq *rq;
+  int i, n;
+
+  if (p->cpu < 0 || p->cpu >= ncpu)
+    p->cpu = 0;
+  rq = &runqs[p->cpu];
+  acquire(&rq->lock);
+  rq_insert(rq, p);
+  n = rq->nrunnable;
+  release(&rq->lock);
+
+  if (cpus[p->cpu].idle)
   {
-    if (p->pid == pid)
+    kick(p->cpu);
+    return;
+  }
+  if (n < 2)
+    return;
+  for (i = 0; i < ncpu; i++)
+  {
+    if (cpus[i].idle)
     {
-      p->arrival_ratio = arrival_ratio;
-      p->priority_ratio = priority_ratio;
-      p->exec_cycle_ratio = exec_cycle_ratio;
+      kick(i);
+      return;
     }
   }
-  return pid;
 }
 
-int set_bjf(int priority_ratio, int arrival_ratio, int exec_cycle_ratio)
+// Nothing to run or steal: halt until an interrupt arrives.
+// The idle flag is published before the queues are checked one
+// last time, and enqueue() checks the flag after linking a
+// proc, so either we see the proc or the enqueuer sees us
+// idle and sends an IPI, which stays pending across the cli
+// and ends the hlt at once.  The last check covers the peers'
+// queues as steal() does: enqueue() on a peer only kicks an
+// idle CPU once that peer has a backlog, and a proc queued
+// there between our failed steal and the idle flag would
+// otherwise wait with this CPU asleep.  CPUs other than 0 also
+// stop their timer while halted; CPU 0 keeps it to count ticks.
+static void
+idle(int id)
 {
-  for (struct proc *p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  struct cpu *c = &cpus[id];
+  uint t0;
+
+  cli();
+  c->idle = 1;
+  __sync_synchronize();
+  if (runqs[id].nrunnable == 0 && busiest(id) < 0)
   {
-    p->arrival_ratio = arrival_ratio;
-    p->priority_ratio = priority_ratio;
-    p->exec_cycle_ratio = exec_cycle_ratio;
+    t0 = ticks;
+    if (id != 0)
+      lapictimer(0);
+    stihlt();
+    cli();
+    if (id != 0)
+      lapictimer(1);
+    c->idleticks += ticks - t0;
   }
-  return 0;
+  c->idle = 0;
+  sti();
 }
 
-int set_ticket(int pid,int first,int last){
-  for(struct proc *p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->first_tick=first;
-      p->last_tick=last;
-    }
+// Take the next proc to run off rq, trying the levels in order.
+// Returns 0 if rq has nothing runnable.
+struct proc *
+dequeue(struct runq *rq)
+{
+  struct proc *p;
+
+  acquire(&rq->lock);
+  p = round_robin_sched(rq);
+  if (p == 0)
+    p = lot_sched(rq);
+  if (p == 0)
+    p = bjf_sched(rq);
+  if (p)
+    rq_remove(rq, p);
+  release(&rq->lock);
+  return p;
+}
+
+// Move p to queue level lvl, relinking it if it is queued.
+// Caller holds ptable.lock, so p cannot be enqueued meanwhile;
+// if a scheduler has already taken it off its queue, rq_cpu
+// no longer matches and only the level changes.
+void
+requeue(struct proc *p, int lvl)
+{
+  struct runq *rq;
+  int c;
+
+  c = p->rq_cpu;
+  if (c < 0) {
+    p->queue_lvl = lvl;
+    return;
   }
-  return pid;
+  rq = &runqs[c];
+  acquire(&rq->lock);
+  if (p->rq_cpu == c) {
+    rq_remove(rq, p);
+    p->queue_lvl = lvl;
+    rq_insert(rq, p);
+  } else
+    p->queue_lvl = lvl;
+  release(&rq->lock);
 }
 
-struct semaphore {
-  int value;
-  int locked;
-  int owner;
-  struct spinlock lock;
-};
+// Priority inheritance.  A process about to sleep on a lock
+// held by one on a later queue level (levels are served in
+// order, round robin first) lifts the holder to its own level,
+// remembering the holder's level in baselvl.  Each lock whose
+// waiters lifted the holder counts once in boosted, and drops
+// its lift when the holder releases it or the waiters give up;
+// the holder goes back to baselvl when no lock's lift is left.
+// held says whether the lock's lift already counts.  Returns
+// whether it counts now.
+// Caller holds ptable.lock.
+static int
+lift(struct proc *p, int lvl, int held)
+{
+  if(p->state == UNUSED || p->state == ZOMBIE ||
+     lvl >= (p->boosted ? p->baselvl : p->queue_lvl))
+    return held;
+  if(!p->boosted)
+    p->baselvl = p->queue_lvl;
+  if(!held)
+    p->boosted++;
+  if(lvl < p->queue_lvl)
+    requeue(p, lvl);
+  return 1;
+}
 
-struct semaphore chop_stick[6];
+int
+boost(struct proc *p, int lvl, int held)
+{
+  acquire(&ptable.lock);
+  held = lift(p, lvl, held);
+  release(&ptable.lock);
+  return held;
+}
 
-int sem_init(int i, int v){
+// Lift the holder of semaphore h known by pid.  The pid comes
+// from user memory, so it is only believed if that process
+// holds h open.  Returns 0 if the process is gone, else
+// whether the semaphore's lift on it counts.
+int
+boostpid(int pid, int lvl, int h, int held)
+{
+  struct proc *p;
 
-  acquire(&chop_stick[i].lock);
+  if((p = lockproc(pid)) == 0)
+    return 0;
+  if(p->semmap[h / 32] & (1 << (h % 32)))
+    held = lift(p, lvl, held);
+  release(&ptable.lock);
+  return held;
+}
 
-  if (chop_stick[i].locked == 0) {
-    chop_stick[i].locked = 1;
-    chop_stick[i].value = v;
-    chop_stick[i].owner = -1;
-  } else {
-    release(&chop_stick[i].lock);
-    return -1;
-  }  
+// Drop one lock's lift on p, and p back to the level it had
+// before it was lifted if that was the last.
+// Caller holds ptable.lock.
+static void
+drop(struct proc *p)
+{
+  if(p->boosted > 0 && --p->boosted == 0)
+    requeue(p, p->baselvl);
+}
 
-  release(&chop_stick[i].lock);
+void
+unboost(struct proc *p)
+{
+  acquire(&ptable.lock);
+  drop(p);
+  release(&ptable.lock);
+}
 
-  return 0;
+// Drop a lock's lift on the holder known by pid, once nobody
+// waits for it.
+void
+unboostpid(int pid)
+{
+  struct proc *p;
 
+  if((p = lockproc(pid)) == 0)
+    return;
+  drop(p);
+  release(&ptable.lock);
 }
 
-int sem_acquire(int i){
+// The peer of CPU self with the most runnable procs, or -1 if
+// none has any.  The counts are read without locks.
+static int
+busiest(int self)
+{
+  int i, n, best, max;
 
-  acquire(&chop_stick[i].lock);
+  best = -1;
+  max = 0;
+  for (i = 0; i < ncpu; i++)
+  {
+    if (i == self)
+      continue;
+    n = runqs[i].nrunnable;
+    if (n > max)
+    {
+      best = i;
+      max = n;
+    }
+  }
+  return best;
+}
 
-  if (chop_stick[i].value >= 1) {
-     chop_stick[i].value = chop_stick[i].value - 1;
-     chop_stick[i].owner = i;
-  } else {
-    while (chop_stick[i].value < 1) sleep(&chop_stick[i],&chop_stick[i].lock);
-    chop_stick[i].value = chop_stick[i].value - 1;
-    chop_stick[i].owner = i;
+// Called when CPU self has nothing runnable: take the next
+// proc from the peer with the most runnable procs.  The proc
+// is run here directly instead of being relinked, so it keeps
+// its queue level and only the victim's lock is taken.
+struct proc *
+steal(int self)
+{
+  struct proc *p;
+  int victim;
+
+  if ((victim = busiest(self)) < 0)
+    return 0;
+  p = dequeue(&runqs[victim]);
+  if (p)
+    trace(TR_STEAL, p, victim);
+  return p;
+}
+
+// Recompute p's rank after its exec_cycle or ratios changed,
+// restoring heap order if p is waiting on a BJF heap.
+// Caller holds ptable.lock (see requeue).
+void
+setrank(struct proc *p)
+{
+  struct runq *rq;
+  int c, rank;
+
+  rank = get_rank(p);
+  c = p->rq_cpu;
+  if (c < 0) {
+    p->rank = rank;
+    return;
+  }
+  rq = &runqs[c];
+  acquire(&rq->lock);
+  p->rank = rank;
+  if (p->rq_cpu == c && p->queue_lvl == BJF_LVL) {
+    heap_up(rq, p->bjf_idx);
+    heap_down(rq, p->bjf_idx);
   }
+  release(&rq->lock);
+}
 
-  release(&chop_stick[i].lock);
+// CPU with the fewest runnable or running procs, used to
+// place new processes.  The counts are read without locks;
+// a stale answer only costs balance, not correctness.
+int
+leastloaded(void)
+{
+  int i, best, load, bestload;
 
-  return 0;
+  best = 0;
+  bestload = -1;
+  for (i = 0; i < ncpu; i++)
+  {
+    load = runqs[i].nrunnable + (cpus[i].proc != 0);
+    if (bestload < 0 || load < bestload)
+    {
+      best = i;
+      bestload = load;
+    }
+  }
+  return best;
 }
 
-int sem_release(int i){
-  
-  acquire(&chop_stick[i].lock);
-  chop_stick[i].value = chop_stick[i].value + 1;
-  chop_stick[i].owner = -1;
-  wakeup(&chop_stick[i]); 
-  release(&chop_stick[i].lock);
+struct proc *
+round_robin_sched(struct runq *rq)
+{
+  return rq->head[ROUND_ROBIN_LVL];
+}
 
+struct proc *
+bjf_sched(struct runq *rq)
+{
+  if (rq->nbjf == 0)
+    return 0;
+  return rq->bjf[0];
+}
+
+// Draw a ticket among all tickets queued on rq.  The tree
+// covers exactly the queued procs, so a draw always hits one.
+struct proc *
+lot_sched(struct runq *rq)
+{
+  struct proc *p;
+  uint ticket;
+
+  if (rq->lottotal == 0)
+    return 0;
+  ticket = rand(rq) % rq->lottotal;
+  p = &ptable.proc[lot_find(rq, ticket)];
+  trace(TR_DRAW, p, ticket);
+  return p;
+}
+
+int set_bjf_process(int pid, int priority_ratio, int arrival_ratio, int exec_cycle_ratio)
+{
+  struct proc *p;
+
+  if ((p = lockproc(pid)) == 0)
+    return pid;
+  p->arrival_ratio = arrival_ratio;
+  p->priority_ratio = priority_ratio;
+  p->exec_cycle_ratio = exec_cycle_ratio;
+  setrank(p);
+  release(&ptable.lock);
+  return pid;
+}
+
+int set_bjf(int priority_ratio, int arrival_ratio, int exec_cycle_ratio)
+{
+  acquire(&ptable.lock);
+  bjfratio.priority = priority_ratio;
+  bjfratio.arrival = arrival_ratio;
+  bjfratio.exec_cycle = exec_cycle_ratio;
+  for (struct proc *p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    p->arrival_ratio = arrival_ratio;
+    p->priority_ratio = priority_ratio;
+    p->exec_cycle_ratio = exec_cycle_ratio;
+    setrank(p);
+  }
+  release(&ptable.lock);
   return 0;
 }
+
+int set_ticket(int pid, int tickets){
+  struct proc *p;
+  struct runq *rq;
+  int c;
+
+  if(tickets < 1 || tickets > MAXTICKETS)
+    return -1;
+  if((p = lockproc(pid)) == 0)
+    return -1;
+  // A queued proc's weight is in its CPU's tree; see requeue.
+  c = p->rq_cpu;
+  if(c < 0)
+    p->tickets = tickets;
+  else {
+    rq = &runqs[c];
+    acquire(&rq->lock);
+    if(p->rq_cpu == c && p->queue_lvl == LOT_LVL)
+      lot_add(rq, p - ptable.proc + 1, tickets - p->tickets);
+    p->tickets = tickets;
+    release(&rq->lock);
+  }
+  release(&ptable.lock);
+  return pid;
+}
@@ -8,6 +8,10 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  uint nswitch;                // Procs this cpu has switched to
+  uint nmigrate;               // Procs this cpu took from other cpus
+  volatile uint idle;          // Halted in scheduler() waiting for work
+  uint idleticks;              // Ticks spent halted
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,6 +38,23 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 enum queuelevel {ROUND_ROBIN_LVL, LOT_LVL, BJF_LVL};
+#define NQUEUE 3               // number of queue levels
+#define DEFTICKETS 10          // lottery tickets of a new proc
+#define MAXTICKETS 100000      // most tickets one proc may hold
+#define AGETICKS 2000          // queue wait before promotion a level up
+#define AGESWEEP 100           // ticks between aging sweeps
+#define MAXQUANTUM 1000        // longest time slice in ticks
+
+// A loadable segment of the program a process runs: memsz
+// bytes at va, of which the first filesz come from the file at
+// off and the rest are zero.
+struct seg {
+  uint va;
+  uint memsz;
+  uint filesz;
+  uint off;
+  int writable;
+};
 
 // Per-process state
 struct proc {
@@ -60,11 +81,29 @@ struct proc {
   int arrival_ratio;
   int exec_cycle;
   int exec_cycle_ratio;
-  int waiting_in_queue_cycle;
-  int last_cpu_time;
+  int rank;                    // Cached get_rank(), in tenths
   uint creation_time;
-  int first_tick;
-  int last_tick;
+  int tickets;                 // Lottery tickets
+  int cpu;                     // CPU whose run queue this proc belongs to
+  int rq_cpu;                  // Run queue it is linked on, or -1
+  uint enqueued;               // ticks when it was last queued
+  int slice;                   // Timer ticks used of the current slice
+  struct proc *rq_next;        // Run queue links
+  struct proc *rq_prev;
+  int bjf_idx;                 // Slot in the BJF heap when queued there
+  int migrations;              // Times taken over by another CPU
+  int boosted;                 // Locks whose waiters lifted it
+  int baselvl;                 // Level to return to when boosted
+  uint cputicks;               // Timer ticks spent RUNNING
+  uint semmap[NSEM/32];        // Semaphores held open, by handle
+  struct proc *pidnext;        // Next in pid hash chain
+  struct proc *semnext;        // Next waiter on the same semaphore
+  int semneed;                 // Units waited for on that semaphore
+  int semgrant;                // Of those, handed over by sem_release
+  int semtimed;                // Waiting with a timeout, so on ticks
+  struct inode *exe;           // Program file, paged in on demand
+  struct seg seg[NSEG];        // Its loadable segments
+  int nseg;
 };
 
 // Process memory is laid out contiguously, low addresses first:
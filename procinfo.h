@@ -0,0 +1,31 @@
+// Values of procinfo.state, as in enum procstate.
+#define PS_UNUSED   0
+#define PS_EMBRYO   1
+#define PS_SLEEPING 2
+#define PS_RUNNABLE 3
+#define PS_RUNNING  4
+#define PS_ZOMBIE   5
+
+// Per-process record copied out by getprocinfo().
+struct procinfo {
+  int pid;
+  int state;          // PS_UNUSED .. PS_ZOMBIE
+  int queue_lvl;      // 0 round robin, 1 lottery, 2 BJF
+  int rank;           // BJF rank in tenths
+  int exec_cycle;
+  int tickets;
+  uint creation_time; // ticks at allocation
+  uint cputicks;      // timer ticks spent running
+  int cpu;            // CPU whose run queue it belongs to
+  int migrations;
+  char name[16];
+};
+
+// Per-CPU record copied out by getprocinfo().
+struct cpuinfo {
+  int cpu;            // -1 past the last CPU
+  int nrunnable;      // procs on its run queues
+  uint nswitch;       // procs it has switched to
+  uint nmigrate;      // procs it took from other CPUs
+  uint idleticks;     // ticks spent halted
+};
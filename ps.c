@@ -2,8 +2,42 @@
 #include "stat.h"
 #include "user.h"
 #include "fcntl.h"
+#include "procinfo.h"
+
+#define MAXPROC 64
+#define MAXCPU  8
+
+static char *states[] = {
+    "UNUSED", "EMBRYO", "SLEEPING", "RUNNABLE", "RUNNING", "ZOMBIE"
+};
+
+struct procinfo procs[MAXPROC];
+struct cpuinfo cpus[MAXCPU];
 
 int main(int argc, char *argv[]) {
-    print_processes();
+    struct procinfo *p;
+    struct cpuinfo *c;
+    char *state;
+    int n;
+
+    if ((n = getprocinfo(procs, MAXPROC, cpus, MAXCPU)) < 0) {
+        printf(2, "ps: getprocinfo failed\n");
+        exit();
+    }
+    printf(1, "name   pid   status   queue   init time   rank   cpu cycles   tickets   cpu ticks   cpu   migrations\n");
+    for (p = procs; p < &procs[n]; p++) {
+        state = "???";
+        if (p->state >= 0 && p->state < sizeof(states) / sizeof(states[0]))
+            state = states[p->state];
+        printf(1, "%s  %d  %s  %d  %d  %d.%d  %d  %d  %d  %d  %d\n",
+               p->name, p->pid, state, p->queue_lvl, p->creation_time,
+               p->rank / 10, p->rank % 10, p->exec_cycle, p->tickets,
+               p->cputicks, p->cpu, p->migrations);
+    }
+    printf(1, "\ncpu   runnable   switches   migrated   idle ticks\n");
+    for (c = cpus; c < &cpus[MAXCPU] && c->cpu >= 0; c++) {
+        printf(1, "%d  %d  %d  %d  %d\n",
+               c->cpu, c->nrunnable, c->nswitch, c->nmigrate, c->idleticks);
+    }
     exit();
-}
\ No newline at end of file
+}
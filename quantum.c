@@ -0,0 +1,19 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+int main(int argc, char *argv[])
+{
+  if (argc != 3)
+  {
+    printf(1, "Usage: quantum <queue> <ticks>\n");
+    exit();
+  }
+
+  int queue = atoi(argv[1]);
+  int ticks = atoi(argv[2]);
+  if (set_quantum(queue, ticks) < 0)
+    printf(1, "quantum: bad queue %d or ticks %d\n", queue, ticks);
+  exit();
+}
\ No newline at end of file
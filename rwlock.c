@@ -0,0 +1,61 @@
+// Reader-writer spin locks.
+//
+// Like spinlocks they keep interrupts off while held, and a
+// holder must not sleep.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "rwlock.h"
+
+void
+initrwlock(struct rwlock *rw, char *name)
+{
+  rw->name = name;
+  rw->count = 0;
+  rw->writers = 0;
+}
+
+void
+acquireread(struct rwlock *rw)
+{
+  int c;
+
+  pushcli();
+  for(;;){
+    while(rw->writers > 0)
+      pause();
+    c = rw->count;
+    if(c >= 0 && cmpxchg(&rw->count, c, c + 1) == c)
+      break;
+  }
+}
+
+void
+releaseread(struct rwlock *rw)
+{
+  if(rw->count <= 0)
+    panic("releaseread");
+  xadd(&rw->count, -1);
+  popcli();
+}
+
+void
+acquirewrite(struct rwlock *rw)
+{
+  pushcli();
+  xadd(&rw->writers, 1);
+  while(cmpxchg(&rw->count, 0, -1) != 0)
+    pause();
+}
+
+void
+releasewrite(struct rwlock *rw)
+{
+  if(rw->count != -1)
+    panic("releasewrite");
+  xchg((volatile uint*)&rw->count, 0);
+  xadd(&rw->writers, -1);
+  popcli();
+}
@@ -0,0 +1,8 @@
+// Reader-writer spin lock.  Any number of readers, or one
+// writer; a waiting writer holds off new readers so that a
+// steady stream of them cannot starve it.
+struct rwlock {
+  volatile int count;    // readers holding it, or -1 for a writer
+  volatile int writers;  // writers waiting or holding it
+  char *name;            // Name of lock.
+};
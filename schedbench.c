@@ -0,0 +1,312 @@
+// Scheduler benchmarks.  Each workload runs for a fixed number
+// of ticks and reports what it measured:
+//   mix      CPU-bound children on all three queue levels:
+//            context switches, per-queue throughput, fairness
+//   pingpong two processes bouncing a byte over pipes
+//   wakeup   sleep(1) latency while CPU hogs compete
+//   forks    concurrent fork/exit/wait loops
+//   lottery  lottery share for 1:2:4 ticket ratios
+// usage: schedbench [workload] [ticks]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "trace.h"
+
+#define HZ      100    // timer ticks per second
+#define UNIT    10000  // spin iterations per unit of work
+
+struct result {
+  int id;
+  int count;
+};
+
+int window = 200;
+struct schedevent ev[256];
+
+void
+fail(char *what)
+{
+  printf(1, "schedbench: %s failed\n", what);
+  exit();
+}
+
+// Units of work done until uptime() reaches end.
+int
+spin(int end)
+{
+  volatile int k;
+  int units;
+
+  units = 0;
+  while(uptime() < end){
+    for(k = 0; k < UNIT; k++)
+      ;
+    units++;
+  }
+  return units;
+}
+
+// Drain the scheduler trace, returning how many picks it held.
+int
+picks(void)
+{
+  int i, n, total;
+
+  total = 0;
+  while((n = schedtrace(ev, sizeof(ev) / sizeof(ev[0]))) > 0)
+    for(i = 0; i < n; i++)
+      if(ev[i].type == TR_PICK)
+        total++;
+  return total;
+}
+
+// Fork n children that spin until tick end.  Child i moves to
+// queue level lvl[i] and takes tix[i] tickets when those are
+// given.  Returns the pipe the results will arrive on.
+int
+spinners(int n, int *lvl, int *tix, int end)
+{
+  struct result r;
+  int i, pid, fds[2];
+
+  if(pipe(fds) < 0)
+    fail("pipe");
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork");
+    if(pid == 0){
+      close(fds[0]);
+      if(lvl)
+        change_queue(getpid(), lvl[i]);
+      if(tix)
+        set_ticket(getpid(), tix[i]);
+      r.id = i;
+      r.count = spin(end);
+      write(fds[1], &r, sizeof(r));
+      exit();
+    }
+  }
+  close(fds[1]);
+  return fds[0];
+}
+
+// Read n results from fd into count[] and reap the children.
+void
+collect(int fd, int n, int *count)
+{
+  struct result r;
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(read(fd, &r, sizeof(r)) != sizeof(r))
+      fail("read");
+    count[r.id] = r.count;
+  }
+  close(fd);
+  for(i = 0; i < n; i++)
+    wait();
+}
+
+void
+mix(void)
+{
+  int lvl[9], work[9], total[3], i, fd, end, n;
+
+  printf(1, "mix: 9 spinners, 3 per queue level, %d ticks\n", window);
+  for(i = 0; i < 9; i++)
+    lvl[i] = i % 3;
+  picks();
+  end = uptime() + window;
+  fd = spinners(9, lvl, 0, end);
+  n = 0;
+  while(uptime() < end){
+    n += picks();
+    sleep(1);
+  }
+  collect(fd, 9, work);
+  n += picks();
+
+  printf(1, "  context switches: %d (%d/s)\n", n, n * HZ / window);
+  total[0] = total[1] = total[2] = 0;
+  for(i = 0; i < 9; i++)
+    total[lvl[i]] += work[i];
+  printf(1, "  throughput, units/tick: rr %d  lottery %d  bjf %d\n",
+         total[0] / window, total[1] / window, total[2] / window);
+  for(i = 0; i < 3; i++){
+    printf(1, "  level %d fairness: ", i);
+    permille("", jain(&work[i * 3], 3));
+  }
+  permille("  overall fairness: ", jain(work, 9));
+}
+
+// Each round trip is two blocking handoffs, so two switches
+// to a process that was sleeping on the pipe.
+void
+pingpong(void)
+{
+  int p1[2], p2[2], pid, trips, end;
+  char c;
+
+  printf(1, "pingpong: %d ticks\n", window);
+  if(pipe(p1) < 0 || pipe(p2) < 0)
+    fail("pipe");
+  pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    close(p1[1]);
+    close(p2[0]);
+    while(read(p1[0], &c, 1) == 1)
+      write(p2[1], &c, 1);
+    exit();
+  }
+  close(p1[0]);
+  close(p2[1]);
+  trips = 0;
+  c = 'x';
+  end = uptime() + window;
+  while(uptime() < end){
+    if(write(p1[1], &c, 1) != 1 || read(p2[0], &c, 1) != 1)
+      fail("pingpong");
+    trips++;
+  }
+  close(p1[1]);
+  close(p2[0]);
+  wait();
+  printf(1, "  round trips: %d, handoffs %d/s\n", trips, 2 * trips * HZ / window);
+}
+
+void
+wakeup(void)
+{
+  int work[4], fd, end, t0, lat, n, sum, max;
+
+  printf(1, "wakeup: sleep(1) against 4 spinners, %d ticks\n", window);
+  // Compete on the spinners' level, not from above it.
+  change_queue(getpid(), 1);
+  end = uptime() + window;
+  fd = spinners(4, 0, 0, end);
+  n = sum = max = 0;
+  while(uptime() < end){
+    t0 = uptime();
+    sleep(1);
+    lat = uptime() - t0 - 1;
+    if(lat < 0)
+      lat = 0;
+    sum += lat;
+    if(lat > max)
+      max = lat;
+    n++;
+  }
+  collect(fd, 4, work);
+  change_queue(getpid(), 0);
+  if(n == 0)
+    n = 1;
+  printf(1, "  %d wakeups, latency avg %d.%d max %d ticks\n",
+         n, sum / n, sum * 10 / n % 10, max);
+}
+
+void
+forks(void)
+{
+  struct result r;
+  int count[4], fds[2], i, pid, end, total;
+
+  printf(1, "forks: 4 concurrent fork/exit/wait loops, %d ticks\n", window);
+  if(pipe(fds) < 0)
+    fail("pipe");
+  end = uptime() + window;
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork");
+    if(pid == 0){
+      close(fds[0]);
+      r.id = i;
+      r.count = 0;
+      while(uptime() < end){
+        pid = fork();
+        if(pid < 0)
+          fail("fork");
+        if(pid == 0)
+          exit();
+        wait();
+        r.count++;
+      }
+      write(fds[1], &r, sizeof(r));
+      exit();
+    }
+  }
+  close(fds[1]);
+  collect(fds[0], 4, count);
+  total = 0;
+  for(i = 0; i < 4; i++)
+    total += count[i];
+  printf(1, "  %d forks, %d/s\n", total, total * HZ / window);
+  permille("  fairness: ", jain(count, 4));
+}
+
+// Two children per ticket class, interleaved so that each CPU
+// queue holds every class.
+void
+lottery(void)
+{
+  int lvl[6], tix[6], work[6], share[3], i, fd, total;
+
+  printf(1, "lottery: tickets 10/20/40, %d ticks\n", window);
+  for(i = 0; i < 6; i++){
+    lvl[i] = 1;
+    tix[i] = 10 << (i % 3);
+  }
+  fd = spinners(6, lvl, tix, uptime() + window);
+  collect(fd, 6, work);
+  total = 0;
+  share[0] = share[1] = share[2] = 0;
+  for(i = 0; i < 6; i++){
+    total += work[i];
+    share[i % 3] += work[i];
+  }
+  if(total == 0)
+    total = 1;
+  for(i = 0; i < 3; i++)
+    printf(1, "  %d tickets: %d%% of work (expected %d%%)\n",
+           10 << i, share[i] * 100 / total, 100 * (1 << i) / 7);
+}
+
+struct bench {
+  char *name;
+  void (*fn)(void);
+} benches[] = {
+  { "mix", mix },
+  { "pingpong", pingpong },
+  { "wakeup", wakeup },
+  { "forks", forks },
+  { "lottery", lottery },
+};
+
+int
+main(int argc, char *argv[])
+{
+  int i, ran;
+
+  if(argc > 2)
+    window = atoi(argv[2]);
+  if(window <= 0)
+    window = 200;
+  // Stay on the round robin level so the measuring process
+  // is not starved by its own CPU-bound children.
+  change_queue(getpid(), 0);
+
+  ran = 0;
+  for(i = 0; i < sizeof(benches) / sizeof(benches[0]); i++){
+    if(argc > 1 && strcmp(argv[1], benches[i].name) != 0)
+      continue;
+    benches[i].fn();
+    ran = 1;
+  }
+  if(!ran)
+    printf(2, "usage: schedbench [mix|pingpong|wakeup|forks|lottery] [ticks]\n");
+  exit();
+}
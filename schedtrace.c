@@ -0,0 +1,174 @@
+// Collect scheduler trace events for a number of ticks and
+// report, per process, its share of the CPU picks, the ticks
+// it waited between wakeup and being picked, and how often it
+// won a lottery draw, was promoted or was stolen by a peer.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "trace.h"
+
+#define MAXEV  16384  // events kept for one report
+#define NSTAT  64     // processes reported
+
+struct pstat {
+  int pid;
+  int picks;
+  int draws;
+  int ages;
+  int steals;
+  int waking;     // woken and not yet picked
+  uint woke;      // tick of that wakeup
+  int nlat;
+  int lat;
+  int maxlat;
+};
+
+struct pstat stats[NSTAT];
+int nstats;
+
+struct pstat*
+lookup(int pid)
+{
+  int i;
+
+  for(i = 0; i < nstats; i++)
+    if(stats[i].pid == pid)
+      return &stats[i];
+  if(nstats == NSTAT)
+    return 0;
+  memset(&stats[nstats], 0, sizeof(stats[0]));
+  stats[nstats].pid = pid;
+  return &stats[nstats++];
+}
+
+// Events from different CPUs arrive ring by ring; put them
+// back in tick order (stable, so per-CPU order survives).
+void
+sortbytick(struct schedevent *ev, struct schedevent *out, int n)
+{
+  uint lo, hi;
+  int i, *count, span;
+
+  lo = hi = ev[0].tick;
+  for(i = 1; i < n; i++){
+    if(ev[i].tick < lo)
+      lo = ev[i].tick;
+    if(ev[i].tick > hi)
+      hi = ev[i].tick;
+  }
+  span = hi - lo + 2;
+  count = malloc(span * sizeof(int));
+  memset(count, 0, span * sizeof(int));
+  for(i = 0; i < n; i++)
+    count[ev[i].tick - lo + 1]++;
+  for(i = 1; i < span; i++)
+    count[i] += count[i-1];
+  for(i = 0; i < n; i++)
+    out[count[ev[i].tick - lo]++] = ev[i];
+  free(count);
+}
+
+void
+account(struct schedevent *e)
+{
+  struct pstat *s;
+  int lat;
+
+  if((s = lookup(e->pid)) == 0)
+    return;
+  switch(e->type){
+  case TR_PICK:
+    s->picks++;
+    if(s->waking){
+      lat = e->tick - s->woke;
+      s->lat += lat;
+      if(lat > s->maxlat)
+        s->maxlat = lat;
+      s->nlat++;
+      s->waking = 0;
+    }
+    break;
+  case TR_WAKEUP:
+    s->waking = 1;
+    s->woke = e->tick;
+    break;
+  case TR_DRAW:
+    s->draws++;
+    break;
+  case TR_AGE:
+    s->ages++;
+    break;
+  case TR_STEAL:
+    s->steals++;
+    break;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedevent *ev, *sorted, junk[64];
+  int i, n, nev, dropped, picks, window;
+  uint end;
+  struct pstat *s;
+
+  window = 100;
+  if(argc > 1)
+    window = atoi(argv[1]);
+  ev = malloc(MAXEV * sizeof(*ev));
+  sorted = malloc(MAXEV * sizeof(*ev));
+  if(ev == 0 || sorted == 0){
+    printf(2, "schedtrace: out of memory\n");
+    exit();
+  }
+
+  // Start from an empty trace.
+  while(schedtrace(junk, sizeof(junk)/sizeof(junk[0])) > 0)
+    ;
+
+  nev = dropped = 0;
+  end = uptime() + window;
+  while(uptime() < end){
+    if(nev < MAXEV){
+      n = schedtrace(ev + nev, MAXEV - nev);
+      if(n < 0){
+        printf(2, "schedtrace: schedtrace failed\n");
+        exit();
+      }
+      nev += n;
+    } else {
+      while((n = schedtrace(junk, sizeof(junk)/sizeof(junk[0]))) > 0)
+        dropped += n;
+    }
+    sleep(1);
+  }
+  if(nev == 0){
+    printf(1, "no scheduling events in %d ticks\n", window);
+    exit();
+  }
+
+  sortbytick(ev, sorted, nev);
+  picks = 0;
+  for(i = 0; i < nev; i++){
+    account(&sorted[i]);
+    if(sorted[i].type == TR_PICK)
+      picks++;
+  }
+
+  printf(1, "%d events over %d ticks, %d picks", nev, window, picks);
+  if(dropped)
+    printf(1, ", %d not kept", dropped);
+  printf(1, "\n");
+  printf(1, "pid   picks  share%%  wakeups  avg-lat  max-lat  draws  ages  steals\n");
+  for(s = stats; s < &stats[nstats]; s++){
+    printf(1, "%d   %d   %d   %d   ", s->pid, s->picks,
+           picks ? s->picks * 100 / picks : 0, s->nlat);
+    if(s->nlat)
+      printf(1, "%d.%d   ", s->lat / s->nlat, s->lat * 10 / s->nlat % 10);
+    else
+      printf(1, "-   ");
+    printf(1, "%d   %d   %d   %d\n", s->maxlat, s->draws, s->ages, s->steals);
+  }
+  exit();
+}
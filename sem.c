@@ -0,0 +1,607 @@
+// Counting semaphores shared between processes.
+//
+// Semaphores live in a fixed table and are looked up by name
+// through a hash, so unrelated processes can share one by
+// agreeing on its name; an empty name makes a private one that
+// is only passed on by fork.  A handle is an index into the
+// table.  Each process keeps a bitmap of the semaphores it
+// holds open and owns one reference on each; fork copies the
+// references and exit drops them, and a slot goes back on the
+// free list when its last reference does.
+//
+// The count itself lives in a page of its own, mapped at
+// SEMPAGE(h) in each process that holds h and in no other, so
+// sem_acquire and sem_release in ulib.c can update it with a
+// locked xadd and never enter the kernel unless they must,
+// while a process that does not hold h cannot touch it.  The
+// page is taken when the slot is and freed with the slot's
+// last reference; each mapping holds a reference of its own.
+// A count above zero is units available; below zero, its
+// negation is the number of processes that have taken one they
+// did not get.  Each of those calls sem_wait, and each release
+// that finds the count negative calls sem_post, so posts and
+// waits pair up one for one whichever reaches the kernel first.
+// After the count, the page holds the pid of the semaphore's
+// last acquirer, which a process about to wait lifts to its own
+// queue level (priority inheritance, see boost in proc.c).  Any
+// holder can write that pid, so it is believed only if the
+// process it names holds the semaphore too.  The holder's
+// release then finds the count negative, enters the kernel,
+// and drops back.  If instead the waiters all give up, through
+// a timeout, kill or destroy, the count is no longer negative
+// and the release stays in user space, so the last waiter to
+// leave drops the holder it lifted.
+//
+// Waiters queue in FIFO order on the semaphore itself.  A post
+// with waiters hands its unit straight to the first one and
+// wakes only that process, so it costs the same however many
+// processes exist, nobody can barge in ahead of a waiter, and
+// the others stay asleep.  A post that arrives before its
+// waiter is banked as a token.  A waiter may need several
+// units, for semop; it stays first in line collecting them
+// until it has them all.  A waiter with a timeout sleeps on
+// ticks instead, so the clock interrupt in trap.c wakes it
+// every tick to check its deadline.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sem.h"
+
+#define SEMNAME   16   // longest name, including the nul
+#define NSEMHASH  64   // hash buckets
+
+struct sem {
+  struct spinlock lock;  // protects tokens, dead and the waiters
+  int tokens;            // posts not yet taken by a waiter
+  struct proc *head;     // waiters, oldest first
+  struct proc *tail;
+  int dead;              // destroyed: operations fail
+  int lifted;            // pid a waiter lifted, until released
+  int stale;             // posts owed to waiters that were killed
+  int ref;               // processes holding it; 0 when free
+  int next;              // next in hash chain or free list
+  char name[SEMNAME];
+};
+
+struct {
+  struct spinlock lock;  // protects ref, next, name and the lists
+  struct sem sem[NSEM];
+  int hash[NSEMHASH];
+  int free;
+} semtable;
+
+static int *count[NSEM]; // each slot's counter page, by handle
+
+#define OWNER(h)  (count[h][1])  // pid of the last acquirer
+
+#define HOLDS(p, h)  ((p)->semmap[(h) / 32] & (1 << ((h) % 32)))
+
+void
+seminit(void)
+{
+  int i;
+
+  initlock(&semtable.lock, "semtable");
+  for(i = 0; i < NSEMHASH; i++)
+    semtable.hash[i] = -1;
+  for(i = 0; i < NSEM; i++){
+    initlock(&semtable.sem[i].lock, "sem");
+    semtable.sem[i].next = i + 1 < NSEM ? i + 1 : -1;
+  }
+  semtable.free = 0;
+  if(SEMPAGE(NSEM) > KERNBASE)
+    panic("seminit: SEMBASE");
+}
+
+static int
+semhash(char *name)
+{
+  uint h;
+
+  for(h = 0; *name; name++)
+    h = h * 31 + *name;
+  return h % NSEMHASH;
+}
+
+// Take semaphore h off its hash chain.
+// Caller holds semtable.lock.
+static void
+unhash(int h)
+{
+  int *pp;
+
+  for(pp = &semtable.hash[semhash(semtable.sem[h].name)]; *pp >= 0;
+      pp = &semtable.sem[*pp].next){
+    if(*pp == h){
+      *pp = semtable.sem[h].next;
+      return;
+    }
+  }
+}
+
+// Drop one reference to h, freeing it with the last one.
+// Caller holds semtable.lock.
+static void
+semput(int h)
+{
+  struct sem *s = &semtable.sem[h];
+
+  if(--s->ref > 0)
+    return;
+  if(s->name[0] && !s->dead)
+    unhash(h);
+  kfree((char*)count[h]);
+  count[h] = 0;
+  s->next = semtable.free;
+  semtable.free = h;
+}
+
+// Open the semaphore called name, creating it with the given
+// value if there is none.  Returns its handle.
+int
+sem_create(char *name, int value)
+{
+  struct proc *curproc = myproc();
+  struct sem *s;
+  char *page;
+  int h, b;
+
+  if(value < 0)
+    return -1;
+  b = semhash(name);
+  acquire(&semtable.lock);
+  if(name[0])
+    for(h = semtable.hash[b]; h >= 0; h = semtable.sem[h].next)
+      if(strncmp(semtable.sem[h].name, name, SEMNAME-1) == 0)
+        goto found;
+  if((h = semtable.free) < 0 || (page = kalloc()) == 0){
+    release(&semtable.lock);
+    return -1;
+  }
+  s = &semtable.sem[h];
+  semtable.free = s->next;
+  memset(page, 0, PGSIZE);
+  count[h] = (int*)page;
+  *count[h] = value;
+  s->tokens = 0;
+  s->lifted = 0;
+  s->stale = 0;
+  s->head = s->tail = 0;
+  s->dead = 0;
+  s->ref = 0;
+  safestrcpy(s->name, name, sizeof(s->name));
+  s->next = -1;
+  if(name[0]){
+    s->next = semtable.hash[b];
+    semtable.hash[b] = h;
+  }
+
+found:
+  if(!HOLDS(curproc, h)){
+    semtable.sem[h].ref++;
+    if(mapsempage(curproc->pgdir, h, (char*)count[h]) < 0){
+      semput(h);
+      release(&semtable.lock);
+      return -1;
+    }
+    curproc->semmap[h / 32] |= 1 << (h % 32);
+  }
+  release(&semtable.lock);
+  return h;
+}
+
+// Wake waiter p.  It sleeps on s, or on ticks if it waits with
+// a timeout, so that the clock interrupt wakes it to check.
+static void
+semwake(struct sem *s, struct proc *p)
+{
+  wakeproc(p, p->semtimed ? (void*)&ticks : (void*)s);
+}
+
+// Destroy h: its name is freed for reuse, waiters and later
+// operations fail, and the caller's reference is dropped.
+int
+sem_destroy(int h)
+{
+  struct proc *curproc = myproc();
+  struct proc *p;
+  struct sem *s;
+
+  if(h < 0 || h >= NSEM || !HOLDS(curproc, h))
+    return -1;
+  s = &semtable.sem[h];
+  acquire(&semtable.lock);
+  acquire(&s->lock);
+  if(!s->dead){
+    if(s->name[0])
+      unhash(h);
+    s->dead = 1;
+    while((p = s->head) != 0){
+      s->head = p->semnext;
+      p->semnext = 0;
+      semwake(s, p);
+    }
+    s->tail = 0;
+  }
+  release(&s->lock);
+  curproc->semmap[h / 32] &= ~(1 << (h % 32));
+  unmapsempage(curproc->pgdir, h);
+  semput(h);
+  release(&semtable.lock);
+  return 0;
+}
+
+// Take curproc off s's wait queue after it gave up waiting.
+static void
+unwait(struct sem *s, struct proc *curproc)
+{
+  struct proc **pp, *prev;
+
+  prev = 0;
+  for(pp = &s->head; *pp; prev = *pp, pp = &(*pp)->semnext){
+    if(*pp == curproc){
+      *pp = curproc->semnext;
+      if(s->tail == curproc)
+        s->tail = prev;
+      curproc->semnext = 0;
+      return;
+    }
+  }
+}
+
+// Undo up to n of a waiter's units in the count.  This is
+// only possible while the count is negative; past that, a post
+// is already due for each one left.  Returns how many are.
+// Caller holds s->lock.
+static int
+deregister(int h, int n)
+{
+  int c;
+
+  while(n > 0 && (c = *count[h]) < 0)
+    if(cmpxchg(count[h], c, c + 1) == c)
+      n--;
+  return n;
+}
+
+// Hand a unit to the first waiter, or bank it if there is none.
+// A waiter leaves the queue once it has all it asked for.  A
+// unit owed to a waiter that was killed goes back to the count
+// instead, and on to a waiter only if the count says one is due.
+// Caller holds s->lock.
+static void
+post(struct sem *s)
+{
+  struct proc *p;
+
+  if(s->stale > 0){
+    s->stale--;
+    if(xadd(count[s - semtable.sem], 1) >= 0)
+      return;
+  }
+  if((p = s->head) == 0){
+    s->tokens++;
+    return;
+  }
+  if(++p->semgrant < p->semneed)
+    return;
+  s->head = p->semnext;
+  if(s->head == 0)
+    s->tail = 0;
+  p->semnext = 0;
+  OWNER(s - semtable.sem) = p->pid;
+  semwake(s, p);
+}
+
+// Return n units to h, posting those that waiters are owed.
+static void
+give(int h, int n)
+{
+  struct sem *s = &semtable.sem[h];
+  int old;
+
+  old = xadd(count[h], n);
+  if(old >= 0)
+    return;
+  if(n > -old)
+    n = -old;
+  acquire(&s->lock);
+  if(s->lifted == myproc()->pid){
+    s->lifted = 0;
+    unboost(myproc());
+  }
+  if(!s->dead)
+    while(n-- > 0)
+      post(s);
+  release(&s->lock);
+}
+
+// Sleep until need units of h have been posted to us; they are
+// already taken from the count.  If killed first, or if timo
+// ticks pass (timo < 0 waits for ever), the units that can
+// still be taken out of the count are, the rest are waited
+// for, and everything, along with the held units got without
+// waiting, is given back.  A killed process does not wait for
+// the rest, whose releaser may itself have died before posting
+// them: they are left to go back to the count as they arrive.
+// Returns 0 or -1.
+static int
+await(int h, int need, int held, int timo)
+{
+  struct proc *curproc = myproc();
+  struct sem *s = &semtable.sem[h];
+  void *chan;
+  uint t0;
+  int got, owner;
+
+  acquire(&s->lock);
+  if(s->dead){
+    release(&s->lock);
+    return -1;
+  }
+  got = s->tokens < need ? s->tokens : need;
+  s->tokens -= got;
+  if(got == need){
+    release(&s->lock);
+    return 0;
+  }
+
+  curproc->semneed = need;
+  curproc->semgrant = got;
+  curproc->semtimed = timo >= 0;
+  curproc->semnext = 0;
+  if(s->tail)
+    s->tail->semnext = curproc;
+  else
+    s->head = curproc;
+  s->tail = curproc;
+  chan = curproc->semtimed ? (void*)&ticks : (void*)s;
+  t0 = ticks;
+  while(curproc->semgrant < need && !s->dead && !curproc->killed &&
+        (timo < 0 || ticks - t0 < timo)){
+    owner = OWNER(h);
+    if(owner > 0 && owner != curproc->pid){
+      if(s->lifted && s->lifted != owner){
+        unboostpid(s->lifted);
+        s->lifted = 0;
+      }
+      if(boostpid(owner, curproc->queue_lvl, h, s->lifted != 0))
+        s->lifted = owner;
+      else
+        s->lifted = 0;
+    }
+    sleep(chan, &s->lock);
+  }
+  if(curproc->semgrant == need){
+    release(&s->lock);
+    return 0;
+  }
+  if(!s->dead){
+    curproc->semneed = curproc->semgrant +
+      deregister(h, need - curproc->semgrant);
+    while(curproc->semgrant < curproc->semneed && !s->dead &&
+          !curproc->killed)
+      sleep(chan, &s->lock);
+    s->stale += curproc->semneed - curproc->semgrant;
+  }
+  unwait(s, curproc);
+  if(s->head == 0 && s->lifted){
+    unboostpid(s->lifted);
+    s->lifted = 0;
+  }
+  got = curproc->semgrant;
+  release(&s->lock);
+  if(!s->dead)
+    give(h, got + held);
+  return -1;
+}
+
+// Take n units of h, sleeping for those that are not there.
+static int
+take(int h, int n)
+{
+  int old, held;
+
+  old = xadd(count[h], -n);
+  if(old >= n)
+    return 0;
+  held = old > 0 ? old : 0;
+  return await(h, n - held, held, -1);
+}
+
+// Take n units of h only if they are all there now.
+static int
+trytake(int h, int n)
+{
+  int c;
+
+  while((c = *count[h]) >= n)
+    if(cmpxchg(count[h], c, c - n) == c)
+      return 1;
+  return 0;
+}
+
+// Slow path of sem_acquire: the caller took a unit from the
+// count that was not there, and sleeps until one is posted.
+int
+sem_wait(int h)
+{
+  if(h < 0 || h >= NSEM || !HOLDS(myproc(), h))
+    return -1;
+  return await(h, 1, 0, -1);
+}
+
+// Slow path of sem_timedacquire: sem_wait, but giving up after
+// timo ticks.
+int
+sem_timedwait(int h, int timo)
+{
+  if(h < 0 || h >= NSEM || !HOLDS(myproc(), h))
+    return -1;
+  return await(h, 1, 0, timo < 0 ? 0 : timo);
+}
+
+// Slow path of sem_release: the count was negative, so a
+// waiter is owed a unit.
+int
+sem_post(int h)
+{
+  struct sem *s;
+
+  if(h < 0 || h >= NSEM || !HOLDS(myproc(), h))
+    return -1;
+  s = &semtable.sem[h];
+  acquire(&s->lock);
+  if(s->lifted == myproc()->pid){
+    s->lifted = 0;
+    unboost(myproc());
+  }
+  if(s->dead){
+    release(&s->lock);
+    return -1;
+  }
+  post(s);
+  release(&s->lock);
+  return 0;
+}
+
+// Apply n operations as one: get all of the acquisitions, then
+// do the releases.  The acquisitions are tried all at once
+// without waiting.  If one cannot be had, what was taken goes
+// back and the caller sleeps for that one alone, then tries the
+// rest around it again, so it never sits on some units while
+// waiting for others.  Returns -1, holding none of them, if
+// killed or a semaphore is destroyed meanwhile.
+int
+semop(struct sembuf *ops, int n)
+{
+  struct proc *curproc = myproc();
+  int i, j, h, k;
+
+  if(n < 1 || n > SEMOPMAX)
+    return -1;
+  for(i = 0; i < n; i++){
+    h = ops[i].sem;
+    if(h < 0 || h >= NSEM || !HOLDS(curproc, h) || ops[i].n == 0)
+      return -1;
+    for(j = 0; j < i; j++)
+      if(ops[j].sem == h)
+        return -1;
+  }
+
+  k = -1;    // op already got by sleeping for it
+  for(;;){
+    for(i = 0; i < n; i++)
+      if(i != k && ops[i].n < 0 && !trytake(ops[i].sem, -ops[i].n))
+        break;
+    if(i == n)
+      break;
+    for(j = 0; j < i; j++)
+      if(j != k && ops[j].n < 0)
+        give(ops[j].sem, -ops[j].n);
+    if(k >= 0)
+      give(ops[k].sem, -ops[k].n);
+    k = i;
+    if(take(ops[k].sem, -ops[k].n) < 0)
+      return -1;
+  }
+
+  for(i = 0; i < n; i++){
+    h = ops[i].sem;
+    if(ops[i].n < 0)
+      OWNER(h) = curproc->pid;
+    else {
+      if(OWNER(h) == curproc->pid)
+        OWNER(h) = 0;
+      give(h, ops[i].n);
+    }
+  }
+  return 0;
+}
+
+// Map the counter page of every semaphore the caller holds into
+// pgdir.  Caller holds semtable.lock.
+static int
+mapall(pde_t *pgdir)
+{
+  struct proc *curproc = myproc();
+  int h;
+
+  for(h = 0; h < NSEM; h++){
+    if(h % 32 == 0 && curproc->semmap[h / 32] == 0){
+      h += 31;
+      continue;
+    }
+    if(HOLDS(curproc, h) && mapsempage(pgdir, h, (char*)count[h]) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Give np a reference on every semaphore the caller holds, and
+// map their counters into its page table.  On failure np holds
+// none; the mappings go with np's page table.
+int
+semdup(struct proc *np)
+{
+  struct proc *curproc = myproc();
+  int h;
+
+  acquire(&semtable.lock);
+  if(mapall(np->pgdir) < 0){
+    release(&semtable.lock);
+    return -1;
+  }
+  for(h = 0; h < NSEM; h++){
+    if(h % 32 == 0 && curproc->semmap[h / 32] == 0){
+      h += 31;
+      continue;
+    }
+    if(HOLDS(curproc, h)){
+      np->semmap[h / 32] |= 1 << (h % 32);
+      semtable.sem[h].ref++;
+    }
+  }
+  release(&semtable.lock);
+  return 0;
+}
+
+// Map the counters of the caller's semaphores into pgdir, the
+// page table of the program it is about to exec.
+int
+semexec(pde_t *pgdir)
+{
+  int r;
+
+  acquire(&semtable.lock);
+  r = mapall(pgdir);
+  release(&semtable.lock);
+  return r;
+}
+
+// Drop every semaphore the exiting process holds.
+void
+semexit(void)
+{
+  struct proc *curproc = myproc();
+  int h;
+
+  acquire(&semtable.lock);
+  for(h = 0; h < NSEM; h++){
+    if(h % 32 == 0 && curproc->semmap[h / 32] == 0){
+      h += 31;
+      continue;
+    }
+    if(HOLDS(curproc, h)){
+      curproc->semmap[h / 32] &= ~(1 << (h % 32));
+      semput(h);
+    }
+  }
+  release(&semtable.lock);
+}
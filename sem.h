@@ -0,0 +1,8 @@
+// One operation for semop(): n > 0 releases n units of
+// semaphore sem, n < 0 acquires -n of them.
+struct sembuf {
+  int sem;
+  int n;
+};
+
+#define SEMOPMAX 8   // operations per semop() call
@@ -16,29 +16,62 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->owner = 0;
+  lk->lifted = 0;
   lk->pid = 0;
 }
 
+#define SPINTRIES 4096  // polls before giving up and sleeping
+
+// Acquire the lock, sleeping if it is held.  While the holder
+// is running on another CPU it will likely let go soon, so
+// first poll for a while rather than pay for a sleep and a
+// wakeup.  The poll holds no lock and leaves interrupts on;
+// owner and its state are only read as a hint.
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *owner;
+  int i;
+
+  for(i = 0; i < SPINTRIES; i++){
+    owner = lk->owner;
+    if(lk->locked == 0 || owner == 0 ||
+       owner->state != RUNNING)
+      break;
+    pause();
+  }
+
   acquire(&lk->lk);
   while (lk->locked) {
+    // Lend the holder our queue level while we wait.
+    if(lk->owner)
+      lk->lifted = boost(lk->owner, myproc()->queue_lvl, lk->lifted);
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
   release(&lk->lk);
 }
 
+// Release the lock, and the lift its waiters gave us, if any.
+// A lift from some other lock's waiters is kept.
 void
 releasesleep(struct sleeplock *lk)
 {
+  int lifted;
+
   acquire(&lk->lk);
+  lifted = lk->lifted;
   lk->locked = 0;
+  lk->owner = 0;
+  lk->lifted = 0;
   lk->pid = 0;
   wakeup(lk);
   release(&lk->lk);
+  if(lifted)
+    unboost(myproc());
 }
 
 int
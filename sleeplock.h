@@ -3,6 +3,9 @@ struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
   
+  struct proc *owner; // Process holding lock, for adaptive spinning
+  int lifted;         // Our waiters lifted the owner
+
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
@@ -8,13 +8,143 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockinfo.h"
+
+#ifdef LOCKSTAT
+#define NLOCKSTAT 64  // distinct lock names tracked
+
+// Contention statistics, kept per lock name so that, say, all
+// the pipe locks add up in one place, and per CPU so that
+// updating them needs no atomics: the CPU holds the lock with
+// interrupts off while it does.
+struct lockstat {
+  char *name;
+  struct {
+    uint nacquire;
+    uint ncontend;
+    uint64 spin;      // cycles waited
+    uint maxhold;     // cycles
+  } cpu[NCPU];
+};
+
+static struct lockstat lockstats[NLOCKSTAT];
+static uint nlockstats;
+static uint lockstatbusy;   // guards registration; not a spinlock,
+                            // which would register itself
+
+// Find or make the statistics for locks called name.
+// Runs from early boot on, so it can't use pushcli.
+static struct lockstat*
+lockstatfor(char *name)
+{
+  struct lockstat *st;
+  uint eflags;
+
+  eflags = readeflags();
+  cli();
+  while(xchg(&lockstatbusy, 1) != 0)
+    pause();
+  for(st = lockstats; st < &lockstats[nlockstats]; st++)
+    if(strncmp(st->name, name, LOCKNAME-1) == 0)
+      goto out;
+  st = 0;
+  if(nlockstats < NLOCKSTAT){
+    st = &lockstats[nlockstats++];
+    st->name = name;
+  }
+out:
+  xchg(&lockstatbusy, 0);
+  if(eflags & FL_IF)
+    sti();
+  return st;
+}
+
+// Count an acquire that started waiting at t0, 0 if it did not.
+static void
+statacquire(struct spinlock *lk, uint64 t0)
+{
+  struct lockstat *st = lk->stat;
+  int id;
+
+  lk->tstart = rdtsc();
+  if(st == 0)
+    return;
+  id = lk->cpu - cpus;
+  st->cpu[id].nacquire++;
+  if(t0){
+    st->cpu[id].ncontend++;
+    st->cpu[id].spin += lk->tstart - t0;
+  }
+}
+
+static void
+statrelease(struct spinlock *lk)
+{
+  struct lockstat *st = lk->stat;
+  uint hold;
+  int id;
+
+  if(st == 0)
+    return;
+  hold = (uint)rdtsc() - lk->tstart;
+  id = lk->cpu - cpus;
+  if(hold > st->cpu[id].maxhold)
+    st->cpu[id].maxhold = hold;
+}
+
+// Copy the statistics of up to n lock names to user address
+// dst, summed over CPUs.  Returns how many were copied.
+int
+lockstatcopy(uint dst, int n)
+{
+  struct lockinfo *li;
+  struct lockstat *st;
+  uint64 spin;
+  int i, c;
+
+  if(n > nlockstats)
+    n = nlockstats;
+  if(n > PGSIZE / sizeof(*li))
+    n = PGSIZE / sizeof(*li);
+  if((li = (struct lockinfo*)kalloc()) == 0)
+    return -1;
+  memset(li, 0, PGSIZE);
+  for(i = 0; i < n; i++){
+    st = &lockstats[i];
+    safestrcpy(li[i].name, st->name, sizeof(li[i].name));
+    spin = 0;
+    for(c = 0; c < NCPU; c++){
+      li[i].nacquire += st->cpu[c].nacquire;
+      li[i].ncontend += st->cpu[c].ncontend;
+      spin += st->cpu[c].spin;
+      if(st->cpu[c].maxhold > li[i].maxhold)
+        li[i].maxhold = st->cpu[c].maxhold;
+    }
+    li[i].spin = spin >> 10;
+  }
+  if(n > 0 && copyout(myproc()->pgdir, dst, li, n * sizeof(*li)) < 0)
+    n = -1;
+  kfree((char*)li);
+  return n;
+}
+#else
+int
+lockstatcopy(uint dst, int n)
+{
+  return -1;
+}
+#endif
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lk->stat = lockstatfor(name);
+#endif
 }
 
 // Acquire the lock.
@@ -24,13 +154,24 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+#ifdef LOCKSTAT
+  uint64 t0;
+#endif
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // Take a ticket and wait for it to come up.  The xadd is
+  // atomic; the wait only reads, so waiters do not pull the
+  // line away from each other until the owner moves on.
+  ticket = xadd((volatile int*)&lk->next, 1);
+#ifdef LOCKSTAT
+  t0 = lk->owner != ticket ? rdtsc() : 0;
+#endif
+  while(lk->owner != ticket)
+    pause();
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +181,9 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+#ifdef LOCKSTAT
+  statacquire(lk, t0);
+#endif
 }
 
 // Release the lock.
@@ -48,6 +192,9 @@ release(struct spinlock *lk)
 {
   if(!holding(lk))
     panic("release");
+#ifdef LOCKSTAT
+  statrelease(lk);
+#endif
 
   lk->pcs[0] = 0;
   lk->cpu = 0;
@@ -59,10 +206,9 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Serve the next ticket.  Only the holder writes owner,
+  // so a plain increment is enough.
+  asm volatile("incl %0" : "+m" (lk->owner) : );
 
   popcli();
 }
@@ -91,7 +237,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->next != lock->owner && lock->cpu == mycpu();
   popcli();
   return r;
 }
@@ -1,11 +1,18 @@
-// Mutual exclusion lock.
+// Mutual exclusion lock.  A ticket lock: CPUs get the lock
+// in the order they asked for it, and waiters only read the
+// owner word while they spin.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;   // Next ticket to hand out
+  volatile uint owner;  // Ticket now holding the lock
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+#ifdef LOCKSTAT
+  struct lockstat *stat;  // Shared by all locks with this name
+  uint tstart;            // rdtsc when it was acquired
+#endif
 };
 
@@ -5,15 +5,15 @@
 
 int main(int argc, char *argv[])
 {
-  if (argc != 4)
+  if (argc != 3)
   {
-    printf(1, "Usage: sbp <pid, priority_ratio, arrival_ratio, exec_cycle_ratio>\n");
+    printf(1, "Usage: st <pid> <tickets>\n");
     exit();
   }
 
   int pid = atoi(argv[1]);
-  int first = atoi(argv[2]);
-  int last = atoi(argv[3]);
-  set_ticket(pid,first,last);
+  int tickets = atoi(argv[2]);
+  if (set_ticket(pid, tickets) < 0)
+    printf(1, "st: bad ticket count %d\n", tickets);
   exit();
 }
\ No newline at end of file
@@ -21,6 +21,8 @@ fetchint(uint addr, int *ip)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
+  if(prefault(addr, 4, 0) < 0)
+    return -1;
   *ip = *(int*)(addr);
   return 0;
 }
@@ -39,6 +41,8 @@ fetchstr(uint addr, char **pp)
   *pp = (char*)addr;
   ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
+    if((s == *pp || (uint)s % PGSIZE == 0) && prefault((uint)s, 1, 0) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
@@ -65,6 +69,8 @@ argptr(int n, char **pp, int size)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  if(prefault(i, size, 0) < 0)
+    return -1;
   *pp = (char*)i;
   return 0;
 }
@@ -106,15 +112,21 @@ extern int sys_uptime(void);
 extern int sys_find_largest_prime_factor(void);
 extern int sys_get_parent_pid(void);
 
-extern int sys_print_processes(void);
+extern int sys_getprocinfo(void);
 extern int sys_change_queue(void);
+extern int sys_set_quantum(void);
+extern int sys_schedtrace(void);
 extern int sys_set_bjf_process(void);
 extern int sys_set_bjf(void);
 extern int sys_set_ticket(void);
 
-extern int sys_sem_init(void);
-extern int sys_sem_acquire(void);
-extern int sys_sem_release(void);
+extern int sys_sem_create(void);
+extern int sys_sem_wait(void);
+extern int sys_sem_post(void);
+extern int sys_sem_destroy(void);
+extern int sys_semop(void);
+extern int sys_sem_timedwait(void);
+extern int sys_lockstat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -140,14 +152,20 @@ static int (*syscalls[])(void) = {
 [SYS_close]   sys_close,
 [SYS_find_largest_prime_factor]       sys_find_largest_prime_factor,
 [SYS_get_parent_pid]       sys_get_parent_pid,
-[SYS_print_processes] sys_print_processes,
+[SYS_getprocinfo] sys_getprocinfo,
 [SYS_change_queue] sys_change_queue,
+[SYS_set_quantum] sys_set_quantum,
+[SYS_schedtrace] sys_schedtrace,
 [SYS_set_bjf_process] sys_set_bjf_process,
 [SYS_set_bjf] sys_set_bjf,
 [SYS_set_ticket] sys_set_ticket,
-[SYS_sem_init] sys_sem_init,
-[SYS_sem_acquire] sys_sem_acquire,
-[SYS_sem_release] sys_sem_release
+[SYS_sem_create] sys_sem_create,
+[SYS_sem_wait] sys_sem_wait,
+[SYS_sem_post] sys_sem_post,
+[SYS_sem_destroy] sys_sem_destroy,
+[SYS_lockstat] sys_lockstat,
+[SYS_semop] sys_semop,
+[SYS_sem_timedwait] sys_sem_timedwait,
 };
 
 void
@@ -21,13 +21,19 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_find_largest_prime_factor  22 
-#define SYS_sem_init 23
-#define SYS_sem_acquire 24
-#define SYS_sem_release 25
+#define SYS_sem_create 23
+#define SYS_sem_wait 24
+#define SYS_sem_post 25
 #define SYS_get_parent_pid 26
 
 #define SYS_change_queue 27
 #define SYS_set_bjf_process 28
 #define SYS_set_bjf 29
 #define SYS_set_ticket 30
-#define SYS_print_processes 31
+#define SYS_getprocinfo 31
+#define SYS_set_quantum 32
+#define SYS_schedtrace 33
+#define SYS_sem_destroy 34
+#define SYS_lockstat 35
+#define SYS_semop 36
+#define SYS_sem_timedwait 37
@@ -6,6 +6,10 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "trace.h"
+#include "procinfo.h"
+#include "lockinfo.h"
+#include "sem.h"
 
 int
 sys_fork(void)
@@ -103,18 +107,71 @@ void sys_get_callers(int syscall_number){
 
 int sys_get_parent_pid(void)
 {
-  struct proc *p = myproc()->parent;
-  while (p->is_tracer) {
-    p = p->tracer_parent;
-  }
-  return p->pid;
+  return parentpid();
 }
 
 
+// Copy up to n struct procinfo records into buf and, if cbuf
+// is not null, nc struct cpuinfo records into cbuf.  The counts
+// are clamped to what can be copied before the buffers are
+// checked, so that their sizes cannot overflow.
 int
-sys_print_processes(void){
-  printp();
-  return 0;
+sys_getprocinfo(void)
+{
+  char *buf, *cbuf;
+  int n, nc;
+
+  if(argint(1, &n) < 0 || n < 0 || argint(3, &nc) < 0 || nc < 0)
+    return -1;
+  if(n > NPROC)
+    n = NPROC;
+  if(nc > NCPU)
+    nc = NCPU;
+  if(argptr(0, &buf, n * sizeof(struct procinfo)) < 0)
+    return -1;
+  if(argint(2, (int*)&cbuf) < 0)
+    return -1;
+  if(cbuf == 0)
+    nc = 0;
+  else if(argptr(2, &cbuf, nc * sizeof(struct cpuinfo)) < 0)
+    return -1;
+  return getprocinfo((uint)buf, n, (uint)cbuf, nc);
+}
+
+// Drain up to n scheduler trace events into buf.  At most a
+// page of them is copied per call, so n is clamped to that
+// before the buffer is checked.
+int
+sys_schedtrace(void)
+{
+  char *buf;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > PGSIZE / sizeof(struct schedevent))
+    n = PGSIZE / sizeof(struct schedevent);
+  if(argptr(0, &buf, n * sizeof(struct schedevent)) < 0)
+    return -1;
+  return tracecopy((uint)buf, n);
+}
+
+// Copy contention statistics for up to n lock names into buf.
+// At most a page of them is copied, so n is clamped to that
+// before the buffer is checked.
+int
+sys_lockstat(void)
+{
+  char *buf;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > PGSIZE / sizeof(struct lockinfo))
+    n = PGSIZE / sizeof(struct lockinfo);
+  if(argptr(0, &buf, n * sizeof(struct lockinfo)) < 0)
+    return -1;
+  return lockstatcopy((uint)buf, n);
 }
 
 int
@@ -127,6 +184,15 @@ sys_change_queue(void) {
   return 0;
 }
 
+int
+sys_set_quantum(void) {
+  int queue;
+  int n;
+  if(argint(0, &queue) < 0 || argint(1, &n) < 0)
+    return -1;
+  return setquantum(queue, n);
+}
+
 int
 sys_set_bjf_process(void) {
   int pid, priority_ratio, arrival_ratio, exec_cycle_ratio;
@@ -149,29 +215,57 @@ sys_set_bjf(void) {
 }
 
 int sys_set_ticket(void){
-  int pid,first,last;
-  argint(0, &pid);
-  argint(1, &first);
-  argint(2, &last);
-  set_ticket(pid,first,last);
+  int pid, tickets;
+  if(argint(0, &pid) < 0 || argint(1, &tickets) < 0)
+    return -1;
+  if(set_ticket(pid, tickets) < 0)
+    return -1;
   return 0;
 }
 
-int sys_sem_init(void){
-  int i , j;
-  argint(0,&i);
-  argint(1,&j);
-  return sem_init(i,j);
+int sys_sem_create(void){
+  char *name;
+  int value;
+  if(argstr(0, &name) < 0 || argint(1, &value) < 0)
+    return -1;
+  return sem_create(name, value);
 }
 
-int sys_sem_acquire(void){
-  int i;
-  argint(0,&i);
-  return sem_acquire(i);
+int sys_sem_wait(void){
+  int h;
+  if(argint(0, &h) < 0)
+    return -1;
+  return sem_wait(h);
 }
 
-int sys_sem_release(void){
-  int i;
-  argint(0,&i);
-  return sem_release(i);
+int sys_sem_post(void){
+  int h;
+  if(argint(0, &h) < 0)
+    return -1;
+  return sem_post(h);
+}
+
+int sys_sem_timedwait(void){
+  int h, timo;
+  if(argint(0, &h) < 0 || argint(1, &timo) < 0)
+    return -1;
+  return sem_timedwait(h, timo);
+}
+
+int sys_sem_destroy(void){
+  int h;
+  if(argint(0, &h) < 0)
+    return -1;
+  return sem_destroy(h);
+}
+
+int sys_semop(void){
+  struct sembuf ops[SEMOPMAX];
+  char *uops;
+  int n;
+  if(argint(1, &n) < 0 || n < 1 || n > SEMOPMAX ||
+     argptr(0, &uops, n * sizeof(ops[0])) < 0)
+    return -1;
+  memmove(ops, uops, n * sizeof(ops[0]));
+  return semop(ops, n);
 }
@@ -0,0 +1,119 @@
+// Scheduler event tracing.
+//
+// Each CPU appends to its own ring with interrupts off, so
+// recording takes no lock.  The head only ever grows; a reader
+// keeps its own tail per CPU and drops whatever was overwritten
+// before it got there.  Readers are serialized by tracelock.
+//
+// A writer can lap a reader that is copying a slot, so each
+// slot carries the number of the event it holds, cleared while
+// the event is being written.  The reader copies a slot out
+// only if that number is the one it expects both before and
+// after the copy, and drops it otherwise.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "trace.h"
+
+#define NTRACE 512  // events per CPU ring
+
+struct traceslot {
+  volatile uint seq;   // event number held, or ~0 while writing
+  struct schedevent ev;
+};
+
+struct tracering {
+  struct traceslot slot[NTRACE];
+  volatile uint head;  // events ever recorded
+  uint tail;           // next event the reader wants
+};
+
+static struct tracering rings[NCPU];
+static struct spinlock tracelock;
+
+void
+traceinit(void)
+{
+  initlock(&tracelock, "trace");
+}
+
+// Record one event on this CPU's ring.
+void
+trace(int type, struct proc *p, int arg)
+{
+  struct tracering *r;
+  struct traceslot *s;
+  struct schedevent *e;
+
+  pushcli();
+  r = &rings[cpuid()];
+  s = &r->slot[r->head % NTRACE];
+  e = &s->ev;
+  s->seq = ~0;
+  __sync_synchronize();
+  e->tick = ticks;
+  e->cpu = cpuid();
+  e->type = type;
+  e->lvl = p->queue_lvl;
+  e->pid = p->pid;
+  e->arg = arg;
+  // Publish the event before moving head past it.
+  __sync_synchronize();
+  s->seq = r->head;
+  __sync_synchronize();
+  r->head++;
+  popcli();
+}
+
+// Copy up to n unread events, at most a page of them, to user
+// address dst and return how many were copied.  Events that
+// were overwritten before being read are skipped.  The slack
+// keeps the reader away from the slots writers are about to
+// reuse.  The events are gathered into a kernel page under
+// tracelock and copied out after it is released, since copyout
+// may fault in the user's page.
+int
+tracecopy(uint dst, int n)
+{
+  struct schedevent *buf;
+  struct tracering *r;
+  struct traceslot *s;
+  uint h, t, i;
+  int c, got;
+
+  if(n > PGSIZE / sizeof(struct schedevent))
+    n = PGSIZE / sizeof(struct schedevent);
+  if((buf = (struct schedevent*)kalloc()) == 0)
+    return -1;
+  got = 0;
+  acquire(&tracelock);
+  for(c = 0; c < ncpu && got < n; c++){
+    r = &rings[c];
+    h = r->head;
+    t = r->tail;
+    if(h - t > NTRACE - NTRACE/4)
+      t = h - (NTRACE - NTRACE/4);
+    for(i = t; i != h && got < n; i++){
+      s = &r->slot[i % NTRACE];
+      if(s->seq != i)
+        continue;
+      __sync_synchronize();
+      buf[got] = s->ev;
+      __sync_synchronize();
+      if(s->seq == i)
+        got++;
+    }
+    r->tail = i;
+  }
+  release(&tracelock);
+  if(got > 0 && copyout(myproc()->pgdir, dst, buf, got * sizeof(*buf)) < 0)
+    got = -1;
+  kfree((char*)buf);
+  return got;
+}
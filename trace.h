@@ -0,0 +1,16 @@
+// Scheduler trace events, as copied out by schedtrace().
+#define TR_PICK    1   // proc chosen to run; arg = rank or tickets
+#define TR_DRAW    2   // lottery winner; arg = ticket drawn
+#define TR_AGE     3   // promoted a level; arg = ticks it waited
+#define TR_WAKEUP  4   // made RUNNABLE; arg = cpu it was queued on
+#define TR_STEAL   5   // taken from a peer; arg = victim cpu
+
+struct schedevent {
+  uint tick;     // ticks when it happened
+  uchar cpu;     // CPU that recorded it
+  uchar type;    // TR_*
+  uchar lvl;     // queue level of the proc
+  uchar pad;
+  int pid;
+  int arg;
+};
@@ -53,7 +53,15 @@ trap(struct trapframe *tf)
       ticks++;
       wakeup(&ticks);
       release(&tickslock);
+      if(ticks % AGESWEEP == 0)
+        age();
     }
+    if(myproc() && myproc()->state == RUNNING)
+      myproc()->cputicks++;
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_RESCHED:
+    // Only there to wake an idle CPU out of hlt.
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -78,6 +86,14 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // Program or heap that nobody has touched yet, or a write
+    // to a page shared copy-on-write.
+    if(myproc() && (lazyfault(myproc(), rcr2()) == 0 ||
+       ((tf->err & FEC_WR) && cowfault(myproc()->pgdir, rcr2()) == 0)))
+      break;
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -100,10 +116,11 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU once its queue level's
+  // time slice is used up.
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+     tf->trapno == T_IRQ0+IRQ_TIMER && timeslice())
     yield();
 
   // Check if the process has been killed since we yielded
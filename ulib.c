@@ -3,6 +3,8 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "param.h"
+#include "memlayout.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -104,3 +106,82 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+static int pid;  // getpid(), once asked for
+
+static int
+mypid(void)
+{
+  if(pid == 0)
+    pid = getpid();
+  return pid;
+}
+
+int
+fork(void)
+{
+  int r;
+
+  if((r = _fork()) == 0)
+    pid = 0;
+  return r;
+}
+
+// Semaphore counts and owners, shared with the kernel (see
+// sem.c).  Only an acquire that finds no unit, or a release
+// that finds a waiter, makes a system call.  A handle the
+// caller does not hold has no page mapped, so using it faults.
+#define semcount(h) (((volatile int*)SEMPAGE(h))[0])
+#define semowner(h) (((volatile int*)SEMPAGE(h))[1])
+
+int
+sem_acquire(int h)
+{
+  if(h < 0 || h >= NSEM)
+    return -1;
+  if(xadd(&semcount(h), -1) <= 0 && sem_wait(h) < 0)
+    return -1;
+  semowner(h) = mypid();
+  return 0;
+}
+
+// Take a unit only if one is there now.
+int
+sem_tryacquire(int h)
+{
+  int c;
+
+  if(h < 0 || h >= NSEM)
+    return -1;
+  while((c = semcount(h)) > 0){
+    if(cmpxchg(&semcount(h), c, c - 1) == c){
+      semowner(h) = mypid();
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// sem_acquire, but give up after n ticks.
+int
+sem_timedacquire(int h, int n)
+{
+  if(h < 0 || h >= NSEM)
+    return -1;
+  if(xadd(&semcount(h), -1) <= 0 && sem_timedwait(h, n) < 0)
+    return -1;
+  semowner(h) = mypid();
+  return 0;
+}
+
+int
+sem_release(int h)
+{
+  if(h < 0 || h >= NSEM)
+    return -1;
+  if(semowner(h) == mypid())
+    semowner(h) = 0;
+  if(xadd(&semcount(h), 1) >= 0)
+    return 0;
+  return sem_post(h);
+}
@@ -1,8 +1,13 @@
 struct stat;
 struct rtcdate;
+struct schedevent;
+struct procinfo;
+struct cpuinfo;
+struct lockinfo;
+struct sembuf;
 
 // system calls
-int fork(void);
+int _fork(void);
 int exit(void) __attribute__((noreturn));
 int wait(void);
 int pipe(int*);
@@ -25,14 +30,20 @@ int sleep(int);
 int uptime(void);
 int find_largest_prime_factor(void);
 int get_parent_pid(void);
-int print_processes(void);
+int getprocinfo(struct procinfo*, int, struct cpuinfo*, int);
+int schedtrace(struct schedevent*, int);
 int change_queue(int, int);
+int set_quantum(int, int);
 int set_bjf_process(int, int, int, int);
 int set_bjf(int, int, int);
-int set_ticket(int,int,int);
-int sem_init(int i, int j);
-int sem_acquire(int i);
-int sem_release(int i);
+int set_ticket(int, int);
+int sem_create(char*, int);
+int sem_destroy(int);
+int lockstat(struct lockinfo*, int);
+int sem_wait(int);
+int sem_post(int);
+int sem_timedwait(int, int);
+int semop(struct sembuf*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -47,3 +58,12 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int fork(void);
+int sem_acquire(int);
+int sem_release(int);
+int sem_tryacquire(int);
+int sem_timedacquire(int, int);
+
+// bench.c, linked into the benchmarks only
+int jain(int*, int);
+void permille(char*, int);
@@ -7,6 +7,9 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "procinfo.h"
+#include "lockinfo.h"
+#include "sem.h"
 
 char buf[8192];
 char name[3];
@@ -400,6 +403,644 @@ preempt(void)
   printf(1, "preempt ok\n");
 }
 
+// Switches made by the schedulers of all CPUs so far; the
+// number of CPUs goes in *n.
+uint
+switches(int *n)
+{
+  struct cpuinfo ci[NCPU];
+  uint sum;
+  int i;
+
+  if(getprocinfo(0, 0, ci, NCPU) < 0){
+    printf(1, "getprocinfo failed\n");
+    exit();
+  }
+  sum = 0;
+  for(i = 0; i < NCPU && ci[i].cpu >= 0; i++)
+    sum += ci[i].nswitch;
+  if(n)
+    *n = i;
+  return sum;
+}
+
+// many children sleeping and waking on every queue level
+// at once, to shake out races in the per-CPU run queues.
+// prints scheduling decisions per tick; compare across -smp.
+void
+runqstress(void)
+{
+  int i, j, pid, start, elapsed;
+  uint nswitch;
+  volatile int k;
+
+  printf(1, "runqstress test\n");
+  nswitch = switches(0);
+  start = uptime();
+  for(i = 0; i < 16; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "runqstress: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      change_queue(getpid(), i % 3);
+      for(j = 0; j < 50; j++){
+        for(k = 0; k < 10000; k++)
+          ;
+        sleep(1);
+      }
+      exit();
+    }
+  }
+  for(i = 0; i < 16; i++){
+    if(wait() < 0){
+      printf(1, "runqstress: wait failed\n");
+      exit();
+    }
+  }
+  if(wait() != -1){
+    printf(1, "runqstress: stray child\n");
+    exit();
+  }
+  elapsed = uptime() - start;
+  if(elapsed < 1)
+    elapsed = 1;
+  nswitch = switches(0) - nswitch;
+  printf(1, "runqstress ok: %d switches in %d ticks, %d per tick\n",
+         nswitch, elapsed, nswitch / elapsed);
+}
+
+// The getprocinfo record of pid, or 0.
+struct procinfo*
+pinfo(int pid)
+{
+  static struct procinfo pi[NPROC];
+  int i, n;
+
+  n = getprocinfo(pi, NPROC, 0, 0);
+  for(i = 0; i < n; i++)
+    if(pi[i].pid == pid)
+      return &pi[i];
+  return 0;
+}
+
+// CPU-bound children holding 30 and 10 lottery tickets share
+// the CPUs for a fixed time.  Each CPU draws its own lottery,
+// so how the children spread over the CPUs decides their
+// shares; each child reports the CPU it ran on, and only the
+// CPUs that held both kinds count, where a heavy child should
+// get three times the work of a light one whatever the number
+// of CPUs.  Four children per CPU, two of each kind, leave
+// every CPU likely to hold both, and at least one must.
+void
+lotterytest(void)
+{
+  static struct cpuinfo ci[NCPU];
+  int i, n, pid, end, fds[2], rec[3];
+  int work[NCPU][2], nkid[NCPU][2];
+  int heavy, light;
+  volatile int k;
+
+  printf(1, "lottery test\n");
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  if(getprocinfo(0, 0, ci, NCPU) < 0){
+    printf(1, "lottery: getprocinfo failed\n");
+    exit();
+  }
+  for(n = 0; n < NCPU && ci[n].cpu == n; n++)
+    ;
+  n *= 4;
+  end = uptime() + 400;
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "lottery: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(fds[0]);
+      rec[0] = (i % 4 == 0 || i % 4 == 3);
+      rec[1] = 0;
+      set_ticket(getpid(), rec[0] ? 30 : 10);
+      while(uptime() < end){
+        for(k = 0; k < 1000; k++)
+          ;
+        rec[1]++;
+      }
+      rec[2] = pinfo(getpid()) ? pinfo(getpid())->cpu : -1;
+      write(fds[1], rec, sizeof(rec));
+      exit();
+    }
+  }
+  close(fds[1]);
+  memset(work, 0, sizeof(work));
+  memset(nkid, 0, sizeof(nkid));
+  for(i = 0; i < n; i++){
+    if(read(fds[0], rec, sizeof(rec)) != sizeof(rec)){
+      printf(1, "lottery: short read\n");
+      exit();
+    }
+    if(rec[2] < 0 || rec[2] >= NCPU){
+      printf(1, "lottery: child on cpu %d\n", rec[2]);
+      exit();
+    }
+    work[rec[2]][rec[0]] += rec[1];
+    nkid[rec[2]][rec[0]]++;
+  }
+  close(fds[0]);
+  for(i = 0; i < n; i++)
+    wait();
+
+  // Sum the per-child averages of the mixed CPUs.
+  heavy = light = 0;
+  for(i = 0; i < NCPU; i++){
+    if(nkid[i][0] == 0 || nkid[i][1] == 0)
+      continue;
+    heavy += work[i][1] / nkid[i][1];
+    light += work[i][0] / nkid[i][0];
+  }
+  if(heavy == 0 && light == 0){
+    printf(1, "lottery: no CPU ran both kinds\n");
+    exit();
+  }
+  if(light == 0 || heavy < light * 9 / 4 || heavy > light * 4){
+    printf(1, "lottery: heavy %d light %d, expected about 3:1\n", heavy, light);
+    exit();
+  }
+  printf(1, "lottery ok: heavy/light = %d.%d\n",
+         heavy / light, heavy * 10 / light % 10);
+}
+
+// getprocinfo must report the caller as running and a
+// sleeping child with the right parent-side pid, and per-CPU
+// records numbered from 0 up to an end marker.
+void
+procinfotest(void)
+{
+  static struct procinfo pi[NPROC];
+  static struct cpuinfo ci[NCPU];
+  int i, n, pid, fds[2], self, child, switches;
+  char c;
+
+  printf(1, "procinfo test\n");
+  if(pipe(fds) != 0){
+    printf(1, "procinfo: pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "procinfo: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[1]);
+    read(fds[0], &c, 1);
+    exit();
+  }
+  close(fds[0]);
+  sleep(2);
+  n = getprocinfo(pi, NPROC, ci, NCPU);
+  self = child = 0;
+  for(i = 0; i < n; i++){
+    if(pi[i].pid == getpid() && pi[i].state == PS_RUNNING)
+      self = 1;
+    if(pi[i].pid == pid && pi[i].state == PS_SLEEPING)
+      child = 1;
+  }
+  write(fds[1], "x", 1);
+  close(fds[1]);
+  wait();
+  if(n <= 0 || !self || !child){
+    printf(1, "procinfo: n %d self %d child %d\n", n, self, child);
+    exit();
+  }
+  switches = 0;
+  for(i = 0; i < NCPU && ci[i].cpu >= 0; i++){
+    if(ci[i].cpu != i){
+      printf(1, "procinfo: cpu record %d says %d\n", i, ci[i].cpu);
+      exit();
+    }
+    switches += ci[i].nswitch;
+  }
+  if(i == 0 || switches == 0){
+    printf(1, "procinfo: %d cpus, %d switches\n", i, switches);
+    exit();
+  }
+  if(getprocinfo(pi, -1, 0, 0) != -1 ||
+     getprocinfo((struct procinfo*)0xffffffff, 1, 0, 0) != -1 ||
+     getprocinfo(pi, 1, (struct cpuinfo*)0xffffffff, 1) != -1){
+    printf(1, "procinfo: bad arguments accepted\n");
+    exit();
+  }
+  printf(1, "procinfo ok\n");
+}
+
+// A semaphore's count, on its page at SEMPAGE(h).
+#define semcount(h) (*(volatile int*)SEMPAGE(h))
+
+// named semaphores: sharing through fork, destroy waking a
+// waiter, FIFO handoff, the user-space fast path, exit
+// releasing what a process held so the table does not run out,
+// and a process that does not hold a semaphore being unable to
+// write its count.
+void
+semtest(void)
+{
+  char name[8];
+  int i, j, h, pid, fds[2], fds2[2], r;
+
+  printf(1, "sem test\n");
+  if(sem_acquire(-1) != -1 || sem_acquire(NSEM + 5) != -1 ||
+     sem_wait(0) != -1 || sem_post(0) != -1){
+    printf(1, "sem: bad handle accepted\n");
+    exit();
+  }
+
+  h = sem_create("", 0);
+  pid = fork();
+  if(pid == 0){
+    if(sem_acquire(h) != 0)
+      printf(1, "sem: child acquire failed\n");
+    exit();
+  }
+  sleep(2);
+  sem_release(h);
+  wait();
+
+  pipe(fds);
+  pid = fork();
+  if(pid == 0){
+    r = sem_acquire(h);
+    write(fds[1], &r, sizeof(r));
+    exit();
+  }
+  sleep(2);
+  if(sem_destroy(h) != 0 || read(fds[0], &r, sizeof(r)) != sizeof(r) || r != -1){
+    printf(1, "sem: destroy did not fail the waiter\n");
+    exit();
+  }
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+
+  // waiters are served in the order they arrived
+  h = sem_create("", 0);
+  pipe(fds);
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid == 0){
+      sem_acquire(h);
+      write(fds[1], &i, sizeof(i));
+      exit();
+    }
+    sleep(2);
+  }
+  for(i = 0; i < 4; i++){
+    sem_release(h);
+    if(read(fds[0], &r, sizeof(r)) != sizeof(r) || r != i){
+      printf(1, "sem: waiter %d woken out of order\n", r);
+      exit();
+    }
+  }
+  for(i = 0; i < 4; i++)
+    wait();
+  close(fds[0]);
+  close(fds[1]);
+  sem_destroy(h);
+
+  // contended and uncontended traffic must leave the
+  // shared count where it started
+  h = sem_create("", 1);
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid == 0){
+      for(j = 0; j < 2000; j++){
+        sem_acquire(h);
+        if(j % 100 == 0)
+          sleep(0);
+        sem_release(h);
+      }
+      exit();
+    }
+  }
+  for(i = 0; i < 4; i++)
+    wait();
+  if(semcount(h) != 1){
+    printf(1, "sem: count %d after stress, expected 1\n", semcount(h));
+    exit();
+  }
+  sem_destroy(h);
+
+  // semaphores a process holds go away when it exits, so
+  // each round can create as many as the last
+  for(i = 0; i < 3; i++){
+    pipe(fds);
+    pid = fork();
+    if(pid == 0){
+      strcpy(name, "ut000");
+      for(j = 0; j < NSEM - 16; j++){
+        name[2] = '0' + j / 100;
+        name[3] = '0' + j / 10 % 10;
+        name[4] = '0' + j % 10;
+        if(sem_create(name, 1) < 0)
+          break;
+      }
+      write(fds[1], &j, sizeof(j));
+      exit();
+    }
+    close(fds[1]);
+    r = -1;
+    if(read(fds[0], &r, sizeof(r)) != sizeof(r) || r != NSEM - 16){
+      printf(1, "sem: create %d failed in round %d\n", r, i);
+      exit();
+    }
+    close(fds[0]);
+    wait();
+  }
+
+  pipe(fds);
+  pipe(fds2);
+  pid = fork();
+  if(pid == 0){
+    close(fds[1]);
+    close(fds2[0]);
+    if(read(fds[0], &h, sizeof(h)) == sizeof(h)){
+      semcount(h) = 1000;
+      write(fds2[1], &h, sizeof(h));
+    }
+    exit();
+  }
+  close(fds[0]);
+  close(fds2[1]);
+  h = sem_create("", 1);
+  write(fds[1], &h, sizeof(h));
+  if(read(fds2[0], &r, sizeof(r)) != 0){
+    printf(1, "sem: non-holder wrote the count\n");
+    exit();
+  }
+  wait();
+  close(fds[1]);
+  close(fds2[0]);
+  if(semcount(h) != 1 || sem_tryacquire(h) != 0 || sem_tryacquire(h) != -1){
+    printf(1, "sem: count disturbed by a non-holder\n");
+    exit();
+  }
+  sem_release(h);
+  sem_destroy(h);
+  printf(1, "sem ok\n");
+}
+
+// semop: bad vectors are refused, a process waiting for part of
+// a vector holds none of it, and multi-unit acquisitions wait
+// until every unit has been released to them.
+void
+semoptest(void)
+{
+  struct sembuf ops[SEMOPMAX + 1];
+  int a, b, i, pid, fds[2];
+  char c;
+
+  printf(1, "semop test\n");
+  a = sem_create("", 1);
+  b = sem_create("", 0);
+  ops[0].sem = a;
+  ops[0].n = -1;
+  ops[1].sem = a;
+  ops[1].n = -1;
+  if(semop(ops, 0) != -1 || semop(ops, SEMOPMAX + 1) != -1 || semop(ops, 2) != -1){
+    printf(1, "semop: bad vector accepted\n");
+    exit();
+  }
+
+  ops[1].sem = b;
+  pipe(fds);
+  pid = fork();
+  if(pid == 0){
+    if(semop(ops, 2) == 0)
+      write(fds[1], "x", 1);
+    exit();
+  }
+  sleep(5);
+  if(semcount(a) != 1){
+    printf(1, "semop: waiter holds a while waiting for b\n");
+    exit();
+  }
+  sem_release(b);
+  if(read(fds[0], &c, 1) != 1 || semcount(a) != 0 || semcount(b) != 0){
+    printf(1, "semop: vector not acquired\n");
+    exit();
+  }
+  wait();
+  sem_destroy(a);
+  sem_destroy(b);
+
+  a = sem_create("", 0);
+  ops[0].sem = a;
+  ops[0].n = -3;
+  pid = fork();
+  if(pid == 0){
+    if(semop(ops, 1) == 0)
+      write(fds[1], "x", 1);
+    exit();
+  }
+  for(i = 0; i < 3; i++){
+    sleep(2);
+    sem_release(a);
+  }
+  if(read(fds[0], &c, 1) != 1 || semcount(a) != 0){
+    printf(1, "semop: multi-unit acquire failed, count %d\n", semcount(a));
+    exit();
+  }
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  sem_destroy(a);
+  printf(1, "semop ok\n");
+}
+
+// sem_tryacquire never waits, sem_timedacquire gives up after
+// its ticks and leaves the count as it found it, and a timed
+// waiter still gets a unit released before its deadline.
+void
+semtimedtest(void)
+{
+  int h, pid, t0, r, fds[2];
+
+  printf(1, "sem timed test\n");
+  h = sem_create("", 0);
+  if(sem_tryacquire(h) != -1 || semcount(h) != 0){
+    printf(1, "semtimed: tryacquire took a missing unit\n");
+    exit();
+  }
+  t0 = uptime();
+  if(sem_timedacquire(h, 5) != -1 || uptime() - t0 < 5 || semcount(h) != 0){
+    printf(1, "semtimed: timeout wrong, count %d\n", semcount(h));
+    exit();
+  }
+  sem_release(h);
+  if(sem_tryacquire(h) != 0 || semcount(h) != 0){
+    printf(1, "semtimed: tryacquire failed\n");
+    exit();
+  }
+
+  pipe(fds);
+  pid = fork();
+  if(pid == 0){
+    r = sem_timedacquire(h, 1000);
+    write(fds[1], &r, sizeof(r));
+    exit();
+  }
+  sleep(5);
+  sem_release(h);
+  if(read(fds[0], &r, sizeof(r)) != sizeof(r) || r != 0 || semcount(h) != 0){
+    printf(1, "semtimed: timed waiter not handed the unit\n");
+    exit();
+  }
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  sem_destroy(h);
+  printf(1, "sem timed ok\n");
+}
+
+// a BJF-level semaphore holder, crowded out by lottery-level
+// spinners, must be lifted to the round robin level of the
+// process waiting for it instead of waiting to be aged, but a
+// process named as holder that does not hold the semaphore
+// must not, and a holder whose waiter gives up drops back.
+void
+inherittest(void)
+{
+  struct procinfo *pi;
+  int i, h, pid, hogs[4], fds[2], start, waited, victim, lvl;
+  volatile int k;
+  char c;
+
+  printf(1, "inherit test\n");
+  h = sem_create("", 1);
+  pipe(fds);
+  pid = fork();
+  if(pid == 0){
+    change_queue(getpid(), 2);
+    sem_acquire(h);
+    write(fds[1], "x", 1);
+    sleep(5);
+    for(i = 0; i < 50; i++)
+      for(k = 0; k < 10000; k++)
+        ;
+    sem_release(h);
+    exit();
+  }
+  read(fds[0], &c, 1);
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < 4; i++){
+    hogs[i] = fork();
+    if(hogs[i] == 0){
+      change_queue(getpid(), 1);
+      for(;;)
+        ;
+    }
+  }
+  change_queue(getpid(), 0);
+  start = uptime();
+  sem_acquire(h);
+  waited = uptime() - start;
+  sem_release(h);
+  change_queue(getpid(), 1);
+  for(i = 0; i < 4; i++){
+    kill(hogs[i]);
+    wait();
+  }
+  wait();
+  sem_destroy(h);
+  if(waited > 300){
+    printf(1, "inherit: waited %d ticks for a boosted holder\n", waited);
+    exit();
+  }
+
+  victim = fork();
+  if(victim == 0){
+    for(;;)
+      sleep(100);
+  }
+  change_queue(victim, 2);
+  h = sem_create("", 0);
+  ((volatile int*)SEMPAGE(h))[1] = victim;  // the owner's pid
+  pid = fork();
+  if(pid == 0){
+    change_queue(getpid(), 0);
+    sem_timedacquire(h, 3);
+    exit();
+  }
+  wait();
+  lvl = (pi = pinfo(victim)) ? pi->queue_lvl : -1;
+  kill(victim);
+  wait();
+  sem_destroy(h);
+  if(lvl != 2){
+    printf(1, "inherit: a non-holder was lifted to level %d\n", lvl);
+    exit();
+  }
+
+  h = sem_create("", 1);
+  pipe(fds);
+  victim = fork();
+  if(victim == 0){
+    sem_acquire(h);
+    write(fds[1], "x", 1);
+    for(;;)
+      sleep(100);
+  }
+  read(fds[0], &c, 1);
+  close(fds[0]);
+  close(fds[1]);
+  change_queue(victim, 2);
+  pid = fork();
+  if(pid == 0){
+    change_queue(getpid(), 0);
+    sem_timedacquire(h, 3);
+    exit();
+  }
+  wait();
+  lvl = (pi = pinfo(victim)) ? pi->queue_lvl : -1;
+  kill(victim);
+  wait();
+  sem_destroy(h);
+  if(lvl != 2){
+    printf(1, "inherit: holder left at level %d after its waiter gave up\n", lvl);
+    exit();
+  }
+  printf(1, "inherit ok\n");
+}
+
+// lock statistics, when the kernel keeps them, must include
+// the process table lock and count its acquires.
+void
+lockstattest(void)
+{
+  static struct lockinfo li[64];
+  int i, n;
+
+  printf(1, "lockstat test\n");
+  if((n = lockstat(li, 64)) < 0){
+    printf(1, "lockstat not built in\n");
+    return;
+  }
+  for(i = 0; i < n; i++)
+    if(strcmp(li[i].name, "ptable") == 0 && li[i].nacquire > 0)
+      break;
+  if(i == n){
+    printf(1, "lockstat: no ptable entry\n");
+    exit();
+  }
+  printf(1, "lockstat ok\n");
+}
+
 // try to find any races between exit and wait
 void
 exitwait(void)
@@ -424,37 +1065,51 @@ exitwait(void)
   printf(1, "exitwait ok\n");
 }
 
+// Use up all memory, then check that it all comes back.  sbrk
+// only moves the end of the address space, so malloc does not
+// fail when memory runs out: the grandchild is killed by the
+// fault that finds no page, and its memory is freed when it is
+// reaped.  It may also run out of address space first, and
+// malloc return 0.
 void
 mem(void)
 {
   void *m1, *m2;
-  int pid, ppid;
+  int pid, fds[2];
+  char c;
 
   printf(1, "mem test\n");
-  ppid = getpid();
+  if(pipe(fds) != 0){
+    printf(1, "mem: pipe failed\n");
+    exit();
+  }
   if((pid = fork()) == 0){
-    m1 = 0;
-    while((m2 = malloc(10001)) != 0){
-      *(char**)m2 = m1;
-      m1 = m2;
-    }
-    while(m1){
-      m2 = *(char**)m1;
-      free(m1);
-      m1 = m2;
+    close(fds[0]);
+    if(fork() == 0){
+      m1 = 0;
+      while((m2 = malloc(10001)) != 0){
+        *(char**)m2 = m1;
+        m1 = m2;
+      }
+      exit();
     }
+    wait();
     m1 = malloc(1024*20);
-    if(m1 == 0){
-      printf(1, "couldn't allocate mem?!!\n");
-      kill(ppid);
-      exit();
+    if(m1 != 0){
+      memset(m1, 0, 1024*20);
+      free(m1);
+      write(fds[1], "x", 1);
     }
-    free(m1);
-    printf(1, "mem ok\n");
     exit();
-  } else {
-    wait();
   }
+  close(fds[1]);
+  if(pid < 0 || read(fds[0], &c, 1) != 1){
+    printf(1, "couldn't allocate mem?!!\n");
+    exit();
+  }
+  close(fds[0]);
+  wait();
+  printf(1, "mem ok\n");
 }
 
 // More file system tests
@@ -1411,6 +2066,284 @@ forktest(void)
   printf(1, "fork test OK\n");
 }
 
+// fork shares memory copy-on-write: each side's writes, from
+// user code or from the kernel into a user buffer, must stay
+// invisible to the other, and the memory must still be freed.
+void
+cowtest(void)
+{
+  enum { N = 64 * 4096 };
+  char *p;
+  int i, pid, fds[2], ok;
+
+  printf(1, "cow test\n");
+  p = sbrk(N);
+  if(p == (char*)-1){
+    printf(1, "cow: sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < N; i += 4096)
+    p[i] = 'p';
+  pipe(fds);
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "cow: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    // leave p + 4096 shared, for the kernel to write into: it
+    // must copy the page too
+    for(i = 0; i < N; i += 4096)
+      if(i != 4096)
+        p[i] = 'c';
+    if(read(fds[0], p + 4096, 1) != 1 || p[4096] != 'k')
+      exit();
+    ok = 1;
+    for(i = 0; i < N; i += 4096)
+      if(p[i] != (i == 4096 ? 'k' : 'c'))
+        ok = 0;
+    write(fds[1], &ok, sizeof(ok));
+    exit();
+  }
+  write(fds[1], "k", 1);
+  wait();
+  if(read(fds[0], &ok, sizeof(ok)) != sizeof(ok) || !ok){
+    printf(1, "cow: child did not see its own writes\n");
+    exit();
+  }
+  for(i = 0; i < N; i += 4096){
+    if(p[i] != 'p'){
+      printf(1, "cow: child %s reached the parent at %d\n",
+             i == 4096 ? "read()" : "write", i);
+      exit();
+    }
+  }
+
+  // the parent writing first leaves the child its copy
+  pid = fork();
+  if(pid == 0){
+    sleep(5);
+    for(i = 0; i < N; i += 4096)
+      if(p[i] != 'p')
+        exit();
+    write(fds[1], "y", 1);
+    exit();
+  }
+  for(i = 0; i < N; i += 4096)
+    p[i] = 'q';
+  wait();
+  close(fds[1]);
+  if(read(fds[0], &ok, 1) != 1){
+    printf(1, "cow: parent write reached the child\n");
+    exit();
+  }
+  close(fds[0]);
+  sbrk(-N);
+  printf(1, "cow ok\n");
+}
+
+// sbrk only moves the break: far more heap than there is memory
+// can be reserved, pages read as zero when first touched, and
+// fork and the kernel cope with the holes.
+void
+lazytest(void)
+{
+  enum { N = 512 * 1024 * 1024 };
+  char *p, *q;
+  int i, pid, fds[2];
+
+  printf(1, "lazy test\n");
+  if(sbrk(SEMBASE) != (char*)-1){
+    printf(1, "lazy: sbrk past the top succeeded\n");
+    exit();
+  }
+  p = sbrk(N);
+  if(p == (char*)-1){
+    printf(1, "lazy: sbrk %d failed\n", N);
+    exit();
+  }
+  for(i = 0; i < N; i += N / 16){
+    if(p[i] != 0){
+      printf(1, "lazy: fresh page not zero\n");
+      exit();
+    }
+    p[i] = 1;
+  }
+
+  pipe(fds);
+  q = p + N / 32;   // not touched yet
+  pid = fork();
+  if(pid == 0){
+    if(p[N / 16] != 1 || q[0] != 0)
+      exit();
+    if(read(fds[0], q, 1) != 1 || q[0] != 'z')
+      exit();
+    write(fds[1], "y", 1);
+    exit();
+  }
+  write(fds[1], "z", 1);
+  wait();
+  close(fds[1]);
+  if(read(fds[0], q + 1, 1) != 1 || q[1] != 'y' || q[0] != 0){
+    printf(1, "lazy: untouched heap broke fork or read\n");
+    exit();
+  }
+  close(fds[0]);
+  sbrk(-N);
+  printf(1, "lazy ok\n");
+}
+
+// Copy file from to to, over what is there.
+void
+cpfile(char *from, char *to)
+{
+  int fd0, fd1, n;
+
+  fd0 = open(from, O_RDONLY);
+  fd1 = open(to, O_CREATE|O_RDWR);
+  if(fd0 < 0 || fd1 < 0){
+    printf(1, "cpfile: cannot open %s or %s\n", from, to);
+    exit();
+  }
+  while((n = read(fd0, buf, sizeof(buf))) > 0)
+    if(write(fd1, buf, n) != n){
+      printf(1, "cpfile: write %s failed\n", to);
+      exit();
+    }
+  close(fd0);
+  close(fd1);
+}
+
+// Run argv with stdin from file in and stdout to file out, and
+// return the first n bytes of out in buf.
+void
+runto(char **argv, char *in, char *out, int n)
+{
+  int fd, pid;
+
+  unlink(out);
+  pid = fork();
+  if(pid == 0){
+    close(0);
+    open(in, O_RDONLY);
+    close(1);
+    open(out, O_CREATE|O_RDWR);
+    exec(argv[0], argv);
+    exit();
+  }
+  wait();
+  memset(buf, 0, n + 1);
+  fd = open(out, O_RDONLY);
+  read(fd, buf, n);
+  close(fd);
+  unlink(out);
+}
+
+// exec pages programs in from the page cache: a program run
+// twice gives the same results, one cannot be written while it
+// runs, and one rewritten in place runs its new text, not pages
+// cached from the old.
+void
+lazyexectest(void)
+{
+  char *argv[] = { "lxprog", "lx", 0 };
+  int fd, pid, r, fds[2];
+
+  printf(1, "lazy exec test\n");
+  fd = open("lxin", O_CREATE|O_RDWR);
+  write(fd, "zz\n", 3);
+  close(fd);
+
+  cpfile("echo", "lxprog");
+  runto(argv, "lxin", "lxout", 3);
+  if(strcmp(buf, "lx\n") != 0){
+    printf(1, "lazyexec: first run printed %s\n", buf);
+    exit();
+  }
+  runto(argv, "lxin", "lxout", 3);
+  if(strcmp(buf, "lx\n") != 0){
+    printf(1, "lazyexec: cached run printed %s\n", buf);
+    exit();
+  }
+
+  cpfile("cat", "lxprog");
+  argv[1] = 0;
+  pipe(fds);
+  pid = fork();
+  if(pid == 0){
+    close(0);
+    dup(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+    exec("lxprog", argv);
+    exit();
+  }
+  close(fds[0]);
+  sleep(5);
+  fd = open("lxprog", O_RDWR);
+  r = write(fd, "x", 1);
+  close(fd);
+  close(fds[1]);
+  wait();
+  if(r != -1){
+    printf(1, "lazyexec: wrote a running program\n");
+    exit();
+  }
+  runto(argv, "lxin", "lxout", 3);
+  if(strcmp(buf, "zz\n") != 0){
+    printf(1, "lazyexec: rewritten program printed %s\n", buf);
+    exit();
+  }
+  unlink("lxprog");
+  unlink("lxin");
+  printf(1, "lazy exec ok\n");
+}
+
+int
+textprobe(void)
+{
+  return 42;
+}
+
+// program text is shared read-only: a process writing to it is
+// killed, and read() into it fails as for a bad pointer.
+void
+sharedtexttest(void)
+{
+  int pid, fds[2], data[2];
+
+  printf(1, "shared text test\n");
+  pipe(fds);
+  pid = fork();
+  if(pid == 0){
+    *(volatile char*)textprobe = 0;
+    write(fds[1], "w", 1);
+    exit();
+  }
+  wait();
+  pid = fork();
+  if(pid == 0){
+    pipe(data);
+    write(data[1], "x", 1);
+    if(read(data[0], (char*)textprobe, 1) != -1)
+      write(fds[1], "r", 1);
+    exit();
+  }
+  wait();
+  close(fds[1]);
+  if(read(fds[0], buf, 1) != 0){
+    printf(1, "sharedtext: child got %c\n", buf[0]);
+    exit();
+  }
+  close(fds[0]);
+  if(textprobe() != 42){
+    printf(1, "sharedtext: text changed under the parent\n");
+    exit();
+  }
+  printf(1, "shared text ok\n");
+}
+
 void
 sbrktest(void)
 {
@@ -1783,6 +2716,14 @@ main(int argc, char *argv[])
   pipe1();
   preempt();
   exitwait();
+  runqstress();
+  lotterytest();
+  procinfotest();
+  semtest();
+  semoptest();
+  semtimedtest();
+  lockstattest();
+  inherittest();
 
   rmdot();
   fourteen();
@@ -1793,6 +2734,10 @@ main(int argc, char *argv[])
   dirfile();
   iref();
   forktest();
+  cowtest();
+  lazytest();
+  lazyexectest();
+  sharedtexttest();
   bigdir(); // slow
 
   uio();
@@ -192,28 +192,30 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
+// Map page, the counter page of semaphore h, at SEMPAGE(h).
+// The mapping holds a reference on the page, dropped when it
+// is unmapped or pgdir is freed.
 int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
+mapsempage(pde_t *pgdir, int h, char *page)
+{
+  if(mappages(pgdir, (char*)SEMPAGE(h), PGSIZE, V2P(page), PTE_W|PTE_U) < 0)
+    return -1;
+  kref(page);
+  return 0;
+}
+
+// Undo mapsempage.
+void
+unmapsempage(pde_t *pgdir, int h)
 {
-  uint i, pa, n;
   pte_t *pte;
 
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
-  }
-  return 0;
+  if((pte = walkpgdir(pgdir, (char*)SEMPAGE(h), 0)) == 0 || !(*pte & PTE_P))
+    return;
+  kfree(P2V(PTE_ADDR(*pte)));
+  *pte = 0;
+  if(pgdir == myproc()->pgdir)
+    lcr3(V2P(pgdir));
 }
 
 // Allocate page tables and physical memory to grow process from oldsz to
@@ -224,7 +226,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz >= KERNBASE)
+  if(newsz > SEMBASE)
     return 0;
   if(newsz < oldsz)
     return oldsz;
@@ -311,39 +313,163 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  Nothing is copied yet: each page is
+// mapped in both, and writable pages lose PTE_W and gain
+// PTE_COW in both, so that whichever writes first takes a
+// page fault and gets its own copy (see cowfault).  pgdir
+// must be the current page table, whose TLB entries for the
+// pages that lost PTE_W are flushed.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
-  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0 || !(*pte & PTE_P))
+      continue;   // heap not touched yet
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
       goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
-      goto bad;
-    }
+    kref(P2V(pa));
   }
+  lcr3(V2P(pgdir));
   return d;
 
 bad:
+  lcr3(V2P(pgdir));
   freevm(d);
   return 0;
 }
 
+// Map the page at va of process p, which is below its size
+// but was never touched: part of the program, which exec did
+// not read, or heap that sbrk grew over.  A program page with
+// nothing to zero, one that is all file or where the segment
+// ends within the file, is the page cache's copy, shared with
+// every process running the program: read-only if the segment
+// is, else copy-on-write.  Other program pages are private,
+// read from the file as far as the segment goes and zero
+// beyond.  Reading the file may sleep.  Returns -1 if va is
+// outside the process or already mapped, or if there is no
+// memory.
+int
+lazyfault(struct proc *p, uint va)
+{
+  pte_t *pte;
+  struct seg *s;
+  uint off, n, perm;
+  char *mem;
+  int r;
+
+  if(va >= p->sz)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walkpgdir(p->pgdir, (void*)va, 0)) != 0 && (*pte & PTE_P))
+    return -1;
+
+  off = n = 0;
+  perm = PTE_W|PTE_U;
+  for(s = p->seg; s < &p->seg[p->nseg]; s++){
+    if(va >= s->va && va - s->va < s->filesz){
+      off = s->off + (va - s->va);
+      n = s->filesz - (va - s->va);
+      if(!s->writable)
+        perm = PTE_U;
+      break;
+    }
+  }
+  if(n >= PGSIZE || (n > 0 && s->memsz - (va - s->va) <= n)){
+    if((mem = pcget(p->exe, off)) == 0)
+      return -1;
+    if(perm & PTE_W)
+      perm = PTE_COW|PTE_U;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(n > 0){
+      ilock(p->exe);
+      r = readi(p->exe, mem, off, n);
+      iunlock(p->exe);
+      if(r < 0){
+        kfree(mem);
+        return -1;
+      }
+    }
+  }
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Map whatever of the current process's [va, va+n) is not
+// mapped yet, and if write is set give it its own copy of any
+// page it shares copy-on-write.  System calls do this to user
+// buffers up front, so that the kernel never faults on them
+// while holding locks: paging from the program file sleeps, and
+// could need the lock of the very inode the call is using.  It
+// also lets a call that finds no memory fail with -1, where a
+// fault in the kernel could only panic.
+int
+prefault(uint va, uint n, int write)
+{
+  struct proc *curproc = myproc();
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    lazyfault(curproc, a);
+    if((pte = walkpgdir(curproc->pgdir, (void*)a, 0)) == 0 || !(*pte & PTE_P))
+      return -1;
+    if(write && !(*pte & PTE_W) && cowfault(curproc->pgdir, a) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Give pgdir its own writable copy of the copy-on-write page
+// holding va, after a write to it faulted.  The last sharer
+// just takes the page over.  The kernel calls this too before
+// writing into a user buffer.  Read-only pages such as program
+// text are not copy-on-write, so writes to them fail, whether
+// the process's own or the kernel's on its behalf.  Returns -1
+// if va is not such a page or there is no memory for the copy.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  uint pa, flags;
+  char *mem;
+
+  if(va >= SEMBASE || (pte = walkpgdir(pgdir, (void*)va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_P|PTE_COW)) != (PTE_P|PTE_COW))
+    return -1;
+  pa = PTE_ADDR(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(krefs(P2V(pa)) == 1){
+    *pte = pa | flags;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, P2V(pa), PGSIZE);
+    *pte = V2P(mem) | flags;
+    kfree(P2V(pa));
+  }
+  if(pgdir == myproc()->pgdir)
+    lcr3(V2P(pgdir));   // flush the stale TLB entry
+  return 0;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -352,7 +478,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -361,16 +487,31 @@ uva2ka(pde_t *pgdir, char *uva)
 
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
-// uva2ka ensures this only works for PTE_U pages.
+// uva2ka ensures this only works for PTE_U pages.  Writes go
+// through the kernel's mapping, which the page protection does
+// not cover, so copy-on-write pages are copied first, read-only
+// ones are refused, and untouched memory of the current process
+// is mapped first.
 int
 copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
   char *buf, *pa0;
   uint n, va0;
+  pte_t *pte;
 
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
+    pte = walkpgdir(pgdir, (char*)va0, 0);
+    if((pte == 0 || !(*pte & PTE_P)) && pgdir == myproc()->pgdir){
+      // The page faulted in may be shared with the page cache.
+      lazyfault(myproc(), va0);
+      pte = walkpgdir(pgdir, (char*)va0, 0);
+    }
+    if(pte == 0 || !(*pte & PTE_P))
+      return -1;
+    if(!(*pte & PTE_W) && cowfault(pgdir, va0) < 0)
+      return -1;
     pa0 = uva2ka(pgdir, (char*)va0);
     if(pa0 == 0)
       return -1;
@@ -117,6 +117,33 @@ sti(void)
   asm volatile("sti");
 }
 
+// Enable interrupts and halt until the next one.  sti only
+// takes effect after the following instruction, so an interrupt
+// that is already pending wakes the hlt instead of being lost.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
+// Time stamp counter.
+static inline uint64
+rdtsc(void)
+{
+  uint64 t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
+// Spin-wait hint: eases the pipeline and the memory bus, and
+// makes the compiler reload whatever the loop is polling.
+static inline void
+pause(void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -130,6 +157,31 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically add v to *addr and return the old value.
+static inline int
+xadd(volatile int *addr, int v)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (v), "+m" (*addr) :
+               :
+               "memory", "cc");
+  return v;
+}
+
+// Atomically store newval in *addr if it holds old.
+// Returns the value *addr held.
+static inline int
+cmpxchg(volatile int *addr, int old, int newval)
+{
+  int prev;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (prev), "+m" (*addr) :
+               "r" (newval), "0" (old) :
+               "memory", "cc");
+  return prev;
+}
+
 static inline uint
 rcr2(void)
 {